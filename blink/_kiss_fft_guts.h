@@ -32,6 +32,16 @@ struct kiss_fft_state{
     kiss_fft_cpx twiddles[1];
 };
 
+/* Here rather than in kiss_fftr.c so tools/gen_fft_plan.py can emit plans as const data */
+struct kiss_fftr_state{
+    kiss_fft_cfg substate;
+    kiss_fft_cpx * tmpbuf;
+    kiss_fft_cpx * super_twiddles;
+#ifdef USE_SIMD
+    void * pad;
+#endif
+};
+
 /*
   Explanation of macros dealing with complex math:
 
@@ -1,15 +1,27 @@
 #include <stdio.h>
+#include <math.h>
+#include <string.h>
 #include "pico/stdlib.h"
 #include "hardware/gpio.h"
 #include "hardware/adc.h"
 #include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
 #include "kiss_fftr.h"
+#include "fft_fixed.h"
+#include "fft_plan.h"
+#include "fft_kernels.h"
+#include "pitch.h"
+#include "yin.h"
+#include "goertzel.h"
+#include "cv_out.h"
 
 #define CAPTURE_CHANNEL 1
 #define LED_PIN 25
 #define CV_OUT_PIN 13
 
 #define VOLT_PER_SEMITONE (1.0 / 12.0)
+#define HALF_SEMITONE_RATIO 1.0293022f // 2^(1/24)
 #define FREQ_0V 27.5 // TODO: set FREQ_0V to be whatever frequency 0V is equal to
 #define NUM_PIANO_KEYS 120
 
@@ -20,18 +32,95 @@
 #define FSAMP 8000 // Hz
 #define CLOCK_DIV (48000000 / FSAMP)
 
-// BE CAREFUL: anything over about 9000 here will cause things
-// to silently break. The code will compile and upload, but due
-// to memory issues nothing will work properly
-#define NSAMP 2048
+// Every buffer sized by NSAMP is static and the FFT plan is const data in flash,
+// so a size that doesn't fit fails at link time. Change FFT_NSAMP in
+// CMakeLists.txt along with it
+// With the HPS and sub-bin interpolation in pitch.c, 512 samples (64ms) tracks
+// bass notes to the semitone that used to need 2048
+#define NSAMP 512
+
+// A new estimate is made every HOP_SIZE samples over the latest NSAMP, so frames
+// overlap by NSAMP - HOP_SIZE. HOP_SIZE = NSAMP gives non-overlapping frames again
+// 256 = 31.25 estimates per second at FSAMP 8000
+#define HOP_SIZE 256
 
 #define LED_DELAY_MS 1000
 
+// Which pitch engine runs on each capture, switchable at run time by sending
+// its letter over USB serial
+// 0 = FFT with harmonic product spectrum, 'f'
+// 1 = YIN in float, 'y'
+// 2 = YIN in integer, for cores without an FPU, 'i'
+// 3 = Goertzel bank on the FREQUENCIES table, per sample, 'g'
+#define PITCH_ENGINE_FFT 0
+#define PITCH_ENGINE_YIN 1
+#define PITCH_ENGINE_YIN_INT 2
+#define PITCH_ENGINE_GOERTZEL 3
+#define PITCH_ENGINE PITCH_ENGINE_FFT
+
+// Notes the Goertzel engine listens for, bit n for FREQUENCIES[n mod 12] (A = bit 0).
+// Fewer notes, fewer filters to run per sample
+#define GOERTZEL_SCALE_MASK GOERTZEL_ALL_NOTES
+
+// Which kiss_fftr build the FFT engine runs on
+// 0  = float, needs an FPU to be quick
+// 16 = fixed point 16 bit, fed straight from the capture, ~45dB SNR against float
+// 32 = fixed point 32 bit, same input path, indistinguishable from float
+#define FFT_FIXED_POINT 0
+
+// 1 = run all three builds on every frame and print cost and agreement against
+// float once a second, to see what the fixed point builds buy on this core
+#define FFT_BENCHMARK 0
+
+#if YIN_FSAMP != FSAMP
+#error "yin.c is built for a different sample rate, set YIN_FSAMP"
+#endif
+#if YIN_NSAMP > NSAMP
+#error "YIN window does not fit in the capture buffer"
+#endif
+#if FFT_PLAN_NFFT != NSAMP
+#error "fft_plan was generated for a different size, set FFT_NSAMP in CMakeLists.txt"
+#endif
+#if FFT_FIXED_POINT != 0 && FFT_FIXED_POINT != 16 && FFT_FIXED_POINT != 32
+#error "FFT_FIXED_POINT must be 0, 16 or 32"
+#endif
+#if NSAMP % HOP_SIZE != 0
+#error "NSAMP must be a multiple of HOP_SIZE"
+#endif
+
 static float FREQUENCIES[NUM_PIANO_KEYS]; // Frequencies of each actual note starting from FREQ_0V
 static float VOLTAGES[NUM_PIANO_KEYS];    // Voltages of each actual note starting from 0V
-dma_channel_config cfg;
-uint dma_chan;
-float freqs[NSAMP];
+
+// Capture runs continuously into two buffers, so the ADC never stops and buffer N
+// is analysed while N+1 fills. A control channel restarts the data channel at
+// each buffer's start from capture_addrs, so a late IRQ can't send it past one.
+// They sit in scratch X, a bank of their own, so the DMA writes don't stall the
+// FFT working on the striped main SRAM (core 1, whose stack is also there, is unused)
+static uint8_t __scratch_x("capture_bufs") capture_bufs[2][HOP_SIZE];
+static uint capture_chan;      // ADC FIFO into a buffer, then chains to the control channel
+static uint capture_ctrl_chan; // Writes the next buffer's address into it, which restarts it
+// Aligned to its size for the control channel's read address wrap
+static uint8_t *capture_addrs[2] __attribute__((aligned(2 * sizeof(uint8_t *)))) = {capture_bufs[0], capture_bufs[1]};
+static volatile uint8_t capture_ready;     // Bit per buffer, set when full, cleared once analysed
+static volatile uint32_t capture_overruns; // Frames overwritten before the analysis released them
+static volatile uint32_t capture_time_us[2]; // When each buffer's last sample arrived
+
+// Circular history of the latest NSAMP samples, every sample is stored twice,
+// NSAMP apart, so the window ending at the newest sample is always contiguous
+// at history + history_pos
+static uint8_t history[2 * NSAMP];
+
+static kiss_fft_scalar fft_in[NSAMP]; // kiss_fft_scalar is a float, also the YIN input
+static kiss_fft_cpx fft_out[NSAMP / 2 + 1];
+// Power spectrum, float for the float FFT, integer for the fixed point ones
+static union
+{
+    float f[NSAMP / 2 + 1];
+    uint32_t q[NSAMP / 2 + 1];
+} fft_power;
+static int fft_peaks[PITCH_PEAKS]; // Bins of the fixed point spectrum's strongest peaks
+static uint history_pos;  // Oldest sample of the current window
+static uint history_fill; // Samples captured so far, up to NSAMP
 
 // Which scale should we quantize to
 // 0 = Chromatic
@@ -52,29 +141,175 @@ static int rootNote = 0;
 // 2 = Sharp
 static short sign = 1;
 
+static int pitch_engine = PITCH_ENGINE;
+static goertzel_bank_t goertzel_bank;
+
 void setup();
-void sample(uint8_t *capture_buf);
+void capture_start();
+void capture_dma_handler();
+int capture_wait();
+void capture_release(int buf);
+uint8_t *history_push(const uint8_t *block);
+void poll_pitch_engine();
 void generateFrequencies();
 void generateVoltages();
 float quantizeValue(float x, float *values);
 void quantizeValue_should_find_nearest_lower();
 
-void sample(uint8_t *capture_buf)
+void capture_start()
 {
     adc_fifo_drain();
-    adc_run(false);
+    dma_channel_start(capture_chan);
+    adc_run(true);
+}
 
-    dma_channel_configure(dma_chan, &cfg,
-                          capture_buf,   // dst
-                          &adc_hw->fifo, // src
-                          NSAMP,         // transfer count
-                          true           // start immediately
-    );
+// A buffer just filled and the data channel is already on the other one
+void capture_dma_handler()
+{
+    if (!dma_channel_get_irq0_status(capture_chan))
+        return;
+    dma_channel_acknowledge_irq0(capture_chan);
+
+    // The control channel chains in cycles, well before this runs. It has read
+    // the address of the buffer now filling and wrapped round to the full one
+    int i = (dma_channel_hw_addr(capture_ctrl_chan)->read_addr - (uintptr_t)capture_addrs) / sizeof(uint8_t *);
+    capture_time_us[i] = time_us_32();
+
+    // The other buffer is being written over. If it was never released the
+    // analysis fell behind, drop it
+    if (capture_ready & (1 << (1 - i)))
+        capture_overruns++;
+    capture_ready = 1 << i;
+    // For capture_wait(), in case the edge lands between its test and its __wfe()
+    __sev();
+}
 
-    gpio_put(LED_PIN, 1);
-    adc_run(true);
-    dma_channel_wait_for_finish_blocking(dma_chan);
-    gpio_put(LED_PIN, 0);
+// Blocks until a buffer is full and returns its index. The analysis has to
+// release it before the other buffer fills, or the next frame overwrites it
+int capture_wait()
+{
+    while (!capture_ready)
+    {
+        __wfe();
+    }
+    return capture_ready & 1 ? 0 : 1;
+}
+
+void capture_release(int buf)
+{
+    uint32_t status = save_and_disable_interrupts();
+    capture_ready &= ~(1 << buf);
+    restore_interrupts(status);
+}
+
+// Appends HOP_SIZE samples to the history and returns the latest NSAMP window,
+// or NULL until NSAMP samples have been seen
+uint8_t *history_push(const uint8_t *block)
+{
+    memcpy(history + history_pos, block, HOP_SIZE);
+    memcpy(history + history_pos + NSAMP, block, HOP_SIZE);
+    history_pos = (history_pos + HOP_SIZE) % NSAMP;
+
+    if (history_fill < NSAMP)
+    {
+        history_fill += HOP_SIZE;
+        if (history_fill < NSAMP)
+            return NULL;
+    }
+    return history + history_pos;
+}
+
+#if FFT_BENCHMARK
+// Float, s16 and s32 spectra of the same frame: time per build and, for the fixed
+// point ones, SNR against float and how often the strongest bin agrees
+void fft_benchmark(const uint8_t *capture)
+{
+    static fft_s16_cfg cfg16;
+    static fft_s32_cfg cfg32;
+    static kiss_fft_scalar in[NSAMP];
+    static kiss_fft_cpx ref[NSAMP / 2 + 1];
+    static kiss_fft_cpx test[NSAMP / 2 + 1];
+    static uint32_t frames, total_us[3], peak_agree[2];
+    static float signal, noise[2];
+
+    if (!cfg16)
+    {
+        cfg16 = fft_s16_alloc(NSAMP);
+        cfg32 = fft_s32_alloc(NSAMP);
+    }
+
+    uint32_t start_us = time_us_32();
+    uint32_t sum = 0;
+    for (int i = 0; i < NSAMP; i++)
+        sum += capture[i];
+    float avg = (float)sum / NSAMP;
+    for (int i = 0; i < NSAMP; i++)
+        in[i] = capture[i] - avg;
+    kiss_fftr(fft_plan, in, ref);
+    total_us[0] += time_us_32() - start_us;
+
+    int ref_peak = 1;
+    for (int k = 1; k <= NSAMP / 2; k++)
+    {
+        signal += ref[k].r * ref[k].r + ref[k].i * ref[k].i;
+        if (ref[k].r * ref[k].r + ref[k].i * ref[k].i > ref[ref_peak].r * ref[ref_peak].r + ref[ref_peak].i * ref[ref_peak].i)
+            ref_peak = k;
+    }
+
+    for (int b = 0; b < 2; b++)
+    {
+        start_us = time_us_32();
+        if (b == 0)
+            fft_s16_u8(cfg16, capture, (float *)test);
+        else
+            fft_s32_u8(cfg32, capture, (float *)test);
+        total_us[b + 1] += time_us_32() - start_us;
+
+        int peak = 1;
+        for (int k = 1; k <= NSAMP / 2; k++)
+        {
+            float dr = test[k].r - ref[k].r;
+            float di = test[k].i - ref[k].i;
+            noise[b] += dr * dr + di * di;
+            if (test[k].r * test[k].r + test[k].i * test[k].i > test[peak].r * test[peak].r + test[peak].i * test[peak].i)
+                peak = k;
+        }
+        peak_agree[b] += peak == ref_peak;
+    }
+
+    if (++frames < FSAMP / HOP_SIZE)
+        return;
+    printf("FFT %u: float %uus, s16 %uus %0.1fdB %u%% peak, s32 %uus %0.1fdB %u%% peak\n", NSAMP,
+           total_us[0] / frames,
+           total_us[1] / frames, 10 * log10f(signal / noise[0]), 100 * peak_agree[0] / frames,
+           total_us[2] / frames, 10 * log10f(signal / noise[1]), 100 * peak_agree[1] / frames);
+    frames = 0;
+    signal = 0;
+    memset(total_us, 0, sizeof(total_us));
+    memset(peak_agree, 0, sizeof(peak_agree));
+    memset(noise, 0, sizeof(noise));
+}
+#endif
+
+// Switches pitch_engine when its letter arrives over USB serial
+void poll_pitch_engine()
+{
+    int c = getchar_timeout_us(0);
+    if (c == 'f')
+        pitch_engine = PITCH_ENGINE_FFT;
+    else if (c == 'y')
+        pitch_engine = PITCH_ENGINE_YIN;
+    else if (c == 'i')
+        pitch_engine = PITCH_ENGINE_YIN_INT;
+    else if (c == 'g')
+    {
+        // Old filter state is from before the switch
+        goertzel_reset(&goertzel_bank);
+        pitch_engine = PITCH_ENGINE_GOERTZEL;
+    }
+    else
+        return;
+    printf("Pitch engine %d\n", pitch_engine);
 }
 
 void setup()
@@ -101,8 +336,9 @@ void setup()
 
     sleep_ms(1000);
     // Set up the DMA to start transferring data as soon as it appears in FIFO
-    uint dma_chan = dma_claim_unused_channel(true);
-    cfg = dma_channel_get_default_config(dma_chan);
+    capture_chan = dma_claim_unused_channel(true);
+    capture_ctrl_chan = dma_claim_unused_channel(true);
+    dma_channel_config cfg = dma_channel_get_default_config(capture_chan);
 
     // Reading from constant address, writing to incrementing byte addresses
     channel_config_set_transfer_data_size(&cfg, DMA_SIZE_8);
@@ -112,82 +348,185 @@ void setup()
     // Pace transfers based on availability of ADC samples
     channel_config_set_dreq(&cfg, DREQ_ADC);
 
-    float f_max = FSAMP;
-    float f_res = f_max / NSAMP;
-    for (int i = 0; i < NSAMP; i++)
-    {
-        freqs[i] = f_res * i;
-    }
+    // Hand over to the other buffer the moment this one is full
+    channel_config_set_chain_to(&cfg, capture_ctrl_chan);
+
+    dma_channel_configure(capture_chan, &cfg,
+                          capture_bufs[0], // dst
+                          &adc_hw->fifo,   // src
+                          HOP_SIZE,        // transfer count, reloads on each restart
+                          false            // started by capture_start()
+    );
+    dma_channel_set_irq0_enabled(capture_chan, true);
+
+    // One address a buffer, round capture_addrs, into the write address trigger
+    dma_channel_config ctrl_cfg = dma_channel_get_default_config(capture_ctrl_chan);
+    channel_config_set_transfer_data_size(&ctrl_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&ctrl_cfg, true);
+    channel_config_set_write_increment(&ctrl_cfg, false);
+    channel_config_set_ring(&ctrl_cfg, false, __builtin_ctz(sizeof(capture_addrs)));
+    dma_channel_configure(capture_ctrl_chan, &ctrl_cfg, &dma_channel_hw_addr(capture_chan)->al2_write_addr_trig,
+                          &capture_addrs[1], 1, false);
+    irq_set_exclusive_handler(DMA_IRQ_0, capture_dma_handler);
+    irq_set_enabled(DMA_IRQ_0, true);
     // END ADC SETUP
 
     // Set up output
-    gpio_set_function(CV_OUT_PIN, GPIO_FUNC_PWM);
+    cv_out_init(CV_OUT_PIN);
 }
 
 int main()
 {
     FILE *fptr;
 
-    uint8_t cap_buf[NSAMP];
-    kiss_fft_scalar fft_in[NSAMP]; // kiss_fft_scalar is a float
-    kiss_fft_cpx fft_out[NSAMP];
-    kiss_fftr_cfg cfg = kiss_fftr_alloc(NSAMP, false, 0, 0);
+#if FFT_FIXED_POINT == 16
+    fft_s16_cfg cfg = fft_s16_alloc(NSAMP);
+#elif FFT_FIXED_POINT == 32
+    fft_s32_cfg cfg = fft_s32_alloc(NSAMP);
+#endif
 
     setup();
     sleep_ms(5000);
 
     generateFrequencies();
     generateVoltages();
+    goertzel_init(&goertzel_bank, FREQUENCIES, NUM_PIANO_KEYS, FSAMP, GOERTZEL_SCALE_MASK);
+#if FFT_PLAN_WINDOWED && FFT_FIXED_POINT == 0
+    // Quinn's estimator assumes rectangular frames
+    pitch_set_interp(PITCH_INTERP_PARABOLIC);
+#endif
 
     quantizeValue_should_find_nearest_lower();
 
     // startBlinking();
-    float f_max = FSAMP;
-    float f_res = f_max / NSAMP;
+    uint32_t frames = 0;
+    uint32_t cv_latency_total_us = 0, cv_latency_max_us = 0;
+    uint64_t fps_start_us = time_us_64();
+    capture_start();
     while (1)
     {
         // printf("f_res: %f, FSAMP: %i, NSAMP: %i, CLKDIV: %i\n", f_res, FSAMP, NSAMP, CLOCK_DIV);
-        // get NSAMP samples at FSAMP
-        sample(cap_buf);
+        poll_pitch_engine();
+
+        // wait for the next HOP_SIZE samples at FSAMP, the following ones are already on their way
+        int buf = capture_wait();
+        uint32_t frame_us = capture_time_us[buf];
+        uint8_t *cap_buf = history_push(capture_bufs[buf]);
+        capture_release(buf);
+        if (cap_buf == NULL)
+            continue;
 
-        // fill fourier transform input while subtracting DC component
-        uint64_t sum = 0;
-        for (int i = 0; i < NSAMP; i++)
+        gpio_put(LED_PIN, 1);
+        uint32_t start_us = time_us_32();
+
+        float max_freq = 0;
+        if (pitch_engine == PITCH_ENGINE_FFT)
         {
-            // printf("%u\n", cap_buf[i]);
-            sum += cap_buf[i];
+#if FFT_FIXED_POINT == 16
+            // straight from the capture into the fixed point transform, DC ends up in bin 0.
+            // Power and peaks in integer too, float only for the HPS candidates
+            int npeaks = fft_s16_power_peaks(cfg, cap_buf, pitch_fft_kmin(NSAMP, FSAMP), fft_power.q, fft_peaks, PITCH_PEAKS);
+            max_freq = pitch_fft_estimate_u32(fft_power.q, NSAMP, FSAMP, fft_peaks, npeaks, fft_s16_bin, cfg);
+#elif FFT_FIXED_POINT == 32
+            int npeaks = fft_s32_power_peaks(cfg, cap_buf, pitch_fft_kmin(NSAMP, FSAMP), fft_power.q, fft_peaks, PITCH_PEAKS);
+            max_freq = pitch_fft_estimate_u32(fft_power.q, NSAMP, FSAMP, fft_peaks, npeaks, fft_s32_bin, cfg);
+#else
+#if FFT_PLAN_WINDOWED
+            // convert, window and sum in one pass, the mean comes off bins 0 and 1 afterwards
+            float offset = fft_window_u8(cap_buf, fft_plan_window, NSAMP, fft_in);
+            kiss_fftr(fft_plan, fft_in, fft_out);
+            fft_window_dc(fft_out, offset, fft_plan_window_bins);
+#else
+            // fill fourier transform input while subtracting DC component
+            uint64_t sum = 0;
+            for (int i = 0; i < NSAMP; i++)
+            {
+                // printf("%u\n", cap_buf[i]);
+                sum += cap_buf[i];
+            }
+            float avg = (float)sum / NSAMP;
+            for (int i = 0; i < NSAMP; i++)
+            {
+                fft_in[i] = (float)cap_buf[i] - avg;
+            }
+
+            // compute fft
+            kiss_fftr(fft_plan, fft_in, fft_out);
+#endif
+
+            // fundamental from the harmonic product spectrum, interpolated between bins
+            max_freq = pitch_fft_estimate(fft_out, NSAMP, FSAMP, fft_power.f);
+#endif
         }
-        float avg = (float)sum / NSAMP;
-        for (int i = 0; i < NSAMP; i++)
+        else if (pitch_engine == PITCH_ENGINE_GOERTZEL)
         {
-            fft_in[i] = (float)cap_buf[i] - avg;
+            // Only the HOP_SIZE new samples, each filter carries its block across hops
+            // and high notes have completed several blocks by now
+            goertzel_update_u8(&goertzel_bank, cap_buf + NSAMP - HOP_SIZE, HOP_SIZE);
+            int key = goertzel_detect(&goertzel_bank);
+            max_freq = key < 0 ? 0 : FREQUENCIES[key];
         }
-
-        // compute fft
-        kiss_fftr(cfg, fft_in, fft_out);
-
-        // compute power and calculate max freq component
-        float max_power = 0;
-        int max_idx = 0;
-        // any frequency bin over NSAMP/2 is aliased (nyquist sampling theorum)
-        for (int i = 0; i < NSAMP / 2; i++)
+        else
         {
-            float power = fft_out[i].r * fft_out[i].r + fft_out[i].i * fft_out[i].i;
-            if (power > max_power)
+            // YIN only needs the latest YIN_NSAMP samples and no DC removal
+            uint8_t *yin_buf = cap_buf + NSAMP - YIN_NSAMP;
+            if (pitch_engine == PITCH_ENGINE_YIN)
             {
-                max_power = power;
-                max_idx = i;
+                for (int i = 0; i < YIN_NSAMP; i++)
+                {
+                    fft_in[i] = yin_buf[i];
+                }
+                max_freq = yin_estimate(fft_in);
             }
+            else
+                max_freq = yin_estimate_u8(yin_buf) / 65536.0f;
+        }
+        uint32_t estimate_us = time_us_32() - start_us;
+        gpio_put(LED_PIN, 0);
+
+#if FFT_BENCHMARK
+        fft_benchmark(cap_buf);
+#endif
+
+        // quantizeValue rounds down, so shift up half a semitone to land on the nearest note.
+        // With no pitch found the CV holds the last note
+        float quantized = quantizeValue(max_freq * HALF_SEMITONE_RATIO, FREQUENCIES);
+        if (max_freq > 0)
+            cv_out_set_frequency(quantized, FREQ_0V);
+
+        // From the newest sample of the frame to the new level being in the PWM ring
+        uint32_t cv_latency_us = time_us_32() - frame_us;
+        cv_latency_total_us += cv_latency_us;
+        if (cv_latency_us > cv_latency_max_us)
+            cv_latency_max_us = cv_latency_us;
+
+        // Sustained estimates per second, FSAMP / HOP_SIZE when keeping up
+        frames++;
+        uint64_t now_us = time_us_64();
+        if (now_us - fps_start_us >= 1000000)
+        {
+            printf("STFT: %0.2f frames/s, hop %u of %u\n", frames * 1e6f / (now_us - fps_start_us), HOP_SIZE, NSAMP);
+            // A note change reaches the output after this, half the analysis window
+            // for it to dominate the frame, one ring pass and the output filter
+            printf("Audio in to CV out: %uus mean, %uus max + %ums window/2 + %0.0fus ring at %0.0fkHz PWM\n",
+                   cv_latency_total_us / frames, cv_latency_max_us, NSAMP * 500 / FSAMP,
+                   CV_OUT_RING * 1e6f / cv_out_pwm_hz(), cv_out_pwm_hz() / 1000);
+            frames = 0;
+            cv_latency_total_us = 0;
+            cv_latency_max_us = 0;
+            fps_start_us = now_us;
         }
 
-        float max_freq = freqs[max_idx];
-        printf("Greatest Frequency Components: %0.1f Hz", max_freq);
-        float quantized = quantizeValue(max_freq, FREQUENCIES);
+        printf("Fundamental: %0.2f Hz (%uus, %u overruns)", max_freq, estimate_us, capture_overruns);
         printf(", Quantized => %0.1f\n", quantized);
     }
 
     // should never get here
-    kiss_fft_free(cfg);
+#if FFT_FIXED_POINT == 16
+    fft_s16_free(cfg);
+#elif FFT_FIXED_POINT == 32
+    fft_s32_free(cfg);
+#endif
 }
 
 void generateFrequencies()
@@ -0,0 +1,91 @@
+#include <math.h>
+#include "cv_out.h"
+#include "hardware/pwm.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+
+#if CV_OUT_RING & (CV_OUT_RING - 1)
+#error "CV_OUT_RING must be a power of 2"
+#endif
+
+// Whole CC register per entry, the other channel of the slice is left at 0
+static uint32_t cv_ring[CV_OUT_RING];
+static uint32_t *cv_ring_start = cv_ring; // Read by the restart channel
+static uint cv_slice;
+static uint cv_shift;
+
+void cv_out_init(uint pin)
+{
+    gpio_set_function(pin, GPIO_FUNC_PWM);
+    cv_slice = pwm_gpio_to_slice_num(pin);
+    cv_shift = pwm_gpio_to_channel(pin) ? PWM_CH0_CC_B_LSB : PWM_CH0_CC_A_LSB;
+
+    pwm_config cfg = pwm_get_default_config();
+    pwm_config_set_wrap(&cfg, CV_OUT_WRAP);
+    pwm_init(cv_slice, &cfg, true);
+
+    uint data_chan = dma_claim_unused_channel(true);
+    uint restart_chan = dma_claim_unused_channel(true);
+
+    // One duty per PWM period, straight into the compare register
+    dma_channel_config data_cfg = dma_channel_get_default_config(data_chan);
+    channel_config_set_transfer_data_size(&data_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&data_cfg, true);
+    channel_config_set_write_increment(&data_cfg, false);
+    channel_config_set_dreq(&data_cfg, pwm_get_dreq(cv_slice));
+    channel_config_set_chain_to(&data_cfg, restart_chan);
+    dma_channel_configure(data_chan, &data_cfg, &pwm_hw->slice[cv_slice].cc, cv_ring, CV_OUT_RING, false);
+
+    // Points the data channel back at the start of the ring and triggers it
+    dma_channel_config restart_cfg = dma_channel_get_default_config(restart_chan);
+    channel_config_set_transfer_data_size(&restart_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&restart_cfg, false);
+    channel_config_set_write_increment(&restart_cfg, false);
+    dma_channel_configure(restart_chan, &restart_cfg, &dma_channel_hw_addr(data_chan)->al3_read_addr_trig,
+                          &cv_ring_start, 1, false);
+
+    cv_out_set_volts(0);
+    dma_channel_start(data_chan);
+}
+
+void cv_out_set_volts(float volts)
+{
+    if (volts < 0)
+        volts = 0;
+    if (volts > CV_OUT_FULL_SCALE_V)
+        volts = CV_OUT_FULL_SCALE_V;
+
+    // Level in PWM counts as Q16, 100% duty is WRAP + 1
+    uint32_t level = (uint32_t)(volts / CV_OUT_FULL_SCALE_V * (CV_OUT_WRAP + 1) * 65536.0f);
+    uint32_t whole = level >> 16;
+    uint32_t frac = level & 0xFFFF;
+
+#if CV_OUT_DITHER
+    // First order sigma-delta: the fraction carries into whole counts so the
+    // ring averages to the exact level
+    uint32_t acc = 0x8000;
+    for (int i = 0; i < CV_OUT_RING; i++)
+    {
+        acc += frac;
+        uint32_t duty = whole + (acc >> 16);
+        acc &= 0xFFFF;
+        cv_ring[i] = (duty > CV_OUT_WRAP + 1 ? CV_OUT_WRAP + 1 : duty) << cv_shift;
+    }
+#else
+    uint32_t duty = whole + (frac >> 15);
+    for (int i = 0; i < CV_OUT_RING; i++)
+        cv_ring[i] = (duty > CV_OUT_WRAP + 1 ? CV_OUT_WRAP + 1 : duty) << cv_shift;
+#endif
+}
+
+void cv_out_set_frequency(float freq, float freq_0v)
+{
+    if (freq <= 0)
+        return;
+    cv_out_set_volts(log2f(freq / freq_0v));
+}
+
+float cv_out_pwm_hz(void)
+{
+    return (float)clock_get_hz(clk_sys) / (CV_OUT_WRAP + 1);
+}
@@ -0,0 +1,52 @@
+#ifndef CV_OUT_H
+#define CV_OUT_H
+
+#include <stdint.h>
+#include "pico/stdlib.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Pitch CV out of one PWM pin, for an RC low pass (and gain stage if the range
+ needs more than the 3.3V rail) into the synth's 1V/oct input.
+
+ A DMA channel paced by the PWM wrap DREQ writes a new duty every PWM period
+ from a ring of CV_OUT_RING values, a second channel restarts it when the ring
+ is done, so the output runs without the CPU. With CV_OUT_DITHER the ring holds
+ a first order sigma-delta sequence around the target level, and the filter
+ averages it to 1/CV_OUT_RING of a PWM step: 16 bits out of a 10 bit PWM at the
+ defaults below.
+
+ A new level is written over the ring in place, so for one pass of the ring
+ (CV_OUT_RING PWM periods, 0.4ms at the defaults) the output is a mix of the
+ old and new patterns.
+*/
+
+// PWM counts per period, 1024 gives 146kHz at 150MHz clk_sys
+#define CV_OUT_WRAP 1023
+
+// Duty values per DMA pass, a power of 2
+#define CV_OUT_RING 64
+
+#define CV_OUT_DITHER 1
+
+// Volts at 100% duty after the output filter and gain stage
+#define CV_OUT_FULL_SCALE_V 3.3f
+
+void cv_out_init(uint pin);
+
+// Clamped to 0..CV_OUT_FULL_SCALE_V
+void cv_out_set_volts(float volts);
+
+// 1V/oct above freq_0v, nothing changes for freq <= 0
+void cv_out_set_frequency(float freq, float freq_0v);
+
+// PWM carrier in Hz, the output filter needs to be well below it
+float cv_out_pwm_hz(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
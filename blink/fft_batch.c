@@ -0,0 +1,61 @@
+/* Lane packing around the kiss_fftr USE_SIMD build, see fft_batch.h */
+#include "kiss_fft_simd.h"
+#include "fft_batch.h"
+
+struct fft_plan_x4
+{
+    int nfft;
+    kiss_fftr_cfg fftr;
+    kiss_fft_scalar *in;
+    kiss_fft_cpx *out;
+};
+
+fft_x4_cfg fft_x4_alloc(int nfft)
+{
+    fft_x4_cfg cfg = (fft_x4_cfg)malloc(sizeof(struct fft_plan_x4));
+    if (!cfg)
+        return NULL;
+
+    cfg->nfft = nfft;
+    cfg->fftr = kiss_fftr_alloc(nfft, 0, NULL, NULL);
+    cfg->in = (kiss_fft_scalar *)KISS_FFT_MALLOC(sizeof(kiss_fft_scalar) * nfft);
+    cfg->out = (kiss_fft_cpx *)KISS_FFT_MALLOC(sizeof(kiss_fft_cpx) * (nfft / 2 + 1));
+    if (!cfg->fftr || !cfg->in || !cfg->out)
+    {
+        fft_x4_free(cfg);
+        return NULL;
+    }
+    return cfg;
+}
+
+void fft_x4_real(fft_x4_cfg cfg, const float *const in[FFT_BATCH_LANES], float *const spectrum[FFT_BATCH_LANES])
+{
+    for (int i = 0; i < cfg->nfft; i++)
+    {
+        cfg->in[i] = _mm_setr_ps(in[0][i], in[1][i], in[2][i], in[3][i]);
+    }
+
+    kiss_fftr(cfg->fftr, cfg->in, cfg->out);
+
+    float r[FFT_BATCH_LANES], im[FFT_BATCH_LANES];
+    for (int k = 0; k <= cfg->nfft / 2; k++)
+    {
+        _mm_storeu_ps(r, cfg->out[k].r);
+        _mm_storeu_ps(im, cfg->out[k].i);
+        for (int lane = 0; lane < FFT_BATCH_LANES; lane++)
+        {
+            spectrum[lane][2 * k] = r[lane];
+            spectrum[lane][2 * k + 1] = im[lane];
+        }
+    }
+}
+
+void fft_x4_free(fft_x4_cfg cfg)
+{
+    if (!cfg)
+        return;
+    KISS_FFT_FREE(cfg->fftr);
+    KISS_FFT_FREE(cfg->in);
+    KISS_FFT_FREE(cfg->out);
+    free(cfg);
+}
@@ -0,0 +1,29 @@
+#ifndef FFT_BATCH_H
+#define FFT_BATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Four real FFTs per call on the USE_SIMD kiss_fftr build, one per SSE lane, for
+ the host tools. The lanes can be four channels of the same frame or four
+ frames of the same channel, anything with the same nfft.
+
+ Input is four pointers to nfft float samples. Each spectrum comes back as
+ nfft/2+1 r,i float pairs, the same as kiss_fftr writes, so it can go straight
+ into pitch_fft_estimate() through a kiss_fft_cpx pointer.
+*/
+
+#define FFT_BATCH_LANES 4
+
+typedef struct fft_plan_x4 *fft_x4_cfg;
+
+fft_x4_cfg fft_x4_alloc(int nfft);
+void fft_x4_real(fft_x4_cfg cfg, const float *const in[FFT_BATCH_LANES], float *const spectrum[FFT_BATCH_LANES]);
+void fft_x4_free(fft_x4_cfg cfg);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,136 @@
+/* Built once per FIXED_POINT variant, see fft_fixed.h */
+#include "kiss_fft_fixed.h"
+#include "fft_fixed.h"
+
+#if FIXED_POINT == 32
+#define FFT_NAME(name) fft_s32_##name
+#define fft_plan fft_plan_s32
+typedef fft_s32_cfg fft_cfg;
+#else
+#define FFT_NAME(name) fft_s16_##name
+#define fft_plan fft_plan_s16
+typedef fft_s16_cfg fft_cfg;
+#endif
+
+// Capture samples are centred and shifted so a full scale byte fills the scalar
+#define INPUT_SHIFT (FIXED_POINT - 8)
+
+struct fft_plan
+{
+    int nfft;
+    float scale; // Back to the float kiss_fftr scale
+    kiss_fftr_cfg fftr;
+    kiss_fft_scalar *in;
+    kiss_fft_cpx *out;
+};
+
+fft_cfg FFT_NAME(alloc)(int nfft)
+{
+    fft_cfg cfg = (fft_cfg)KISS_FFT_MALLOC(sizeof(struct fft_plan));
+    if (!cfg)
+        return NULL;
+
+    cfg->nfft = nfft;
+    cfg->fftr = kiss_fftr_alloc(nfft, 0, NULL, NULL);
+    cfg->in = (kiss_fft_scalar *)KISS_FFT_MALLOC(sizeof(kiss_fft_scalar) * nfft);
+    cfg->out = (kiss_fft_cpx *)KISS_FFT_MALLOC(sizeof(kiss_fft_cpx) * (nfft / 2 + 1));
+    if (!cfg->fftr || !cfg->in || !cfg->out)
+    {
+        FFT_NAME(free)(cfg);
+        return NULL;
+    }
+
+    // The fixed point transform divides by nfft along the way to stay in range
+    cfg->scale = (float)nfft / (1u << INPUT_SHIFT);
+    return cfg;
+}
+
+static void transform(fft_cfg cfg, const uint8_t *capture)
+{
+    for (int i = 0; i < cfg->nfft; i++)
+    {
+        cfg->in[i] = (kiss_fft_scalar)((capture[i] - 128) * (1 << INPUT_SHIFT));
+    }
+
+    kiss_fftr(cfg->fftr, cfg->in, cfg->out);
+}
+
+void FFT_NAME(u8)(fft_cfg cfg, const uint8_t *capture, float *spectrum)
+{
+    transform(cfg, capture);
+
+    // Centring on 128 leaves the signal offset in bin 0, where the float path
+    // has already removed the mean
+    spectrum[0] = 0;
+    spectrum[1] = 0;
+    for (int k = 1; k <= cfg->nfft / 2; k++)
+    {
+        spectrum[2 * k] = cfg->out[k].r * cfg->scale;
+        spectrum[2 * k + 1] = cfg->out[k].i * cfg->scale;
+    }
+}
+
+// |X[k]|^2 at the s16 build's scale. Each square fits unsigned, and their sum
+#if FIXED_POINT == 32
+static inline uint32_t bin_power(kiss_fft_cpx c)
+{
+    return (uint32_t)(((uint64_t)((int64_t)c.r * c.r) + (uint64_t)((int64_t)c.i * c.i)) >> 32);
+}
+#else
+static inline uint32_t bin_power(kiss_fft_cpx c)
+{
+    return (uint32_t)((int32_t)c.r * c.r) + (uint32_t)((int32_t)c.i * c.i);
+}
+#endif
+
+// Into the peaks list, kept sorted strongest first and at most top_k long
+static int insert_peak(int *peaks, const uint32_t *power, int count, int top_k, int bin)
+{
+    if (count == top_k && power[bin] <= power[peaks[count - 1]])
+        return count;
+    int i = count < top_k ? count++ : count - 1;
+    for (; i > 0 && power[peaks[i - 1]] < power[bin]; i--)
+        peaks[i] = peaks[i - 1];
+    peaks[i] = bin;
+    return count;
+}
+
+// fft_power_peaks() (fft_kernels.h) on the integer spectrum
+int FFT_NAME(power_peaks)(fft_cfg cfg, const uint8_t *capture, int kmin, uint32_t *power, int *peaks, int top_k)
+{
+    transform(cfg, capture);
+
+    int nbins = cfg->nfft / 2 + 1;
+    int count = 0;
+    power[0] = 0; // The offset centring left, as in FFT_NAME(u8)
+    for (int k = 1; k < nbins; k++)
+    {
+        power[k] = bin_power(cfg->out[k]);
+
+        // Bin k - 1 is a peak once it's known to be at least as high as both neighbours
+        uint32_t prev = power[k - 1];
+        if (k - 1 >= kmin && k >= 2 && prev >= power[k - 2] && prev >= power[k] && prev > 0)
+            count = insert_peak(peaks, power, count, top_k, k - 1);
+    }
+    uint32_t last = power[nbins - 1];
+    if (nbins - 1 >= kmin && last >= power[nbins - 2] && last > 0)
+        count = insert_peak(peaks, power, count, top_k, nbins - 1);
+    return count;
+}
+
+void FFT_NAME(bin)(const void *cfg, int k, float *re_im)
+{
+    fft_cfg plan = (fft_cfg)cfg;
+    re_im[0] = plan->out[k].r * plan->scale;
+    re_im[1] = plan->out[k].i * plan->scale;
+}
+
+void FFT_NAME(free)(fft_cfg cfg)
+{
+    if (!cfg)
+        return;
+    kiss_fftr_free(cfg->fftr);
+    KISS_FFT_FREE(cfg->in);
+    KISS_FFT_FREE(cfg->out);
+    KISS_FFT_FREE(cfg);
+}
@@ -0,0 +1,57 @@
+#ifndef FFT_FIXED_H
+#define FFT_FIXED_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Real FFT of the 8 bit capture on the fixed point kiss_fftr builds, for cores
+ without an FPU.
+
+ Samples go straight from the capture into the transform input: centred on 128
+ and shifted up to the top of the scalar, no float buffer and no pass to find
+ the mean. A constant offset only lands in bin 0 of an unwindowed transform,
+ so the result matches removing the mean first for every other bin and bin 0
+ is returned as zero.
+
+ The spectrum comes back as nfft/2+1 r,i float pairs scaled to match the float
+ kiss_fftr of (capture - mean), so it can go straight into pitch_fft_estimate()
+ through a kiss_fft_cpx pointer. That converts and squares every bin in float,
+ in software on a core without an FPU, so the tracker uses the _power_peaks()
+ path below and these are for comparing against the float transform.
+*/
+
+typedef struct fft_plan_s16 *fft_s16_cfg;
+typedef struct fft_plan_s32 *fft_s32_cfg;
+
+fft_s16_cfg fft_s16_alloc(int nfft);
+void fft_s16_u8(fft_s16_cfg cfg, const uint8_t *capture, float *spectrum);
+void fft_s16_free(fft_s16_cfg cfg);
+
+fft_s32_cfg fft_s32_alloc(int nfft);
+void fft_s32_u8(fft_s32_cfg cfg, const uint8_t *capture, float *spectrum);
+void fft_s32_free(fft_s32_cfg cfg);
+
+/*
+ The whole FPU-less path into pitch_fft_estimate_u32(): the same transform, then
+ the power spectrum and the peak search in integer too, so no bin goes through
+ float. power gets |X[k]|^2 for nfft/2+1 bins, bin 0 zeroed as above, at the s16
+ build's scale in both builds (the s32 one shifted down 32 bits, a full scale
+ input stays under 2^31). peaks gets the bins of the top_k strongest local
+ maxima from kmin up, strongest first. Returns how many
+*/
+int fft_s16_power_peaks(fft_s16_cfg cfg, const uint8_t *capture, int kmin, uint32_t *power, int *peaks, int top_k);
+int fft_s32_power_peaks(fft_s32_cfg cfg, const uint8_t *capture, int kmin, uint32_t *power, int *peaks, int top_k);
+
+// Bin k of the last transform as an r,i float pair, scaled as fft_s16_u8() would.
+// A pitch_bin_fn, for the few bins pitch_fft_estimate_u32() interpolates
+void fft_s16_bin(const void *cfg, int k, float *re_im);
+void fft_s32_bin(const void *cfg, int k, float *re_im);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
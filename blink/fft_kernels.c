@@ -0,0 +1,55 @@
+#include "fft_kernels.h"
+
+float fft_window_u8(const uint8_t *capture, const float *window, int n, kiss_fft_scalar *out)
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < n; i++)
+    {
+        sum += capture[i];
+        out[i] = window[i] * (int)(capture[i] - 128);
+    }
+    return (float)sum / n - 128;
+}
+
+void fft_window_dc(kiss_fft_cpx *spectrum, float offset, const kiss_fft_cpx *window_bins)
+{
+    for (int k = 0; k < 2; k++)
+    {
+        spectrum[k].r -= offset * window_bins[k].r;
+        spectrum[k].i -= offset * window_bins[k].i;
+    }
+}
+
+// Into the peaks list, kept sorted strongest first and at most top_k long
+static int insert_peak(fft_peak_t *peaks, int count, int top_k, int bin, float power)
+{
+    if (count == top_k && power <= peaks[count - 1].power)
+        return count;
+    int i = count < top_k ? count++ : count - 1;
+    for (; i > 0 && peaks[i - 1].power < power; i--)
+        peaks[i] = peaks[i - 1];
+    peaks[i].bin = bin;
+    peaks[i].power = power;
+    return count;
+}
+
+int fft_power_peaks(const kiss_fft_cpx *spectrum, int nbins, int kmin, float *power, fft_peak_t *peaks, int top_k)
+{
+    int count = 0;
+    float prev2 = 0, prev = 0;
+
+    for (int k = 0; k < nbins; k++)
+    {
+        float p = spectrum[k].r * spectrum[k].r + spectrum[k].i * spectrum[k].i;
+        power[k] = p;
+
+        // Bin k - 1 is a peak once it's known to be at least as high as both neighbours
+        if (k - 1 >= kmin && k >= 2 && prev >= prev2 && prev >= p && prev > 0)
+            count = insert_peak(peaks, count, top_k, k - 1, prev);
+        prev2 = prev;
+        prev = p;
+    }
+    if (nbins - 1 >= kmin && prev >= prev2 && prev > 0)
+        count = insert_peak(peaks, count, top_k, nbins - 1, prev);
+    return count;
+}
@@ -0,0 +1,48 @@
+#ifndef FFT_KERNELS_H
+#define FFT_KERNELS_H
+
+#include <stdint.h>
+#include "kiss_fft.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Single pass kernels either side of the real FFT, so each buffer is walked once.
+
+ Before: the 8 bit capture is converted, windowed and summed in one pass. The
+ mean can't be subtracted before it is known, so the window is applied to
+ (x - 128) and the remaining offset is taken off the spectrum afterwards: a
+ constant c under the window w transforms to c * W[k], and a Hann window's W[k]
+ is zero past bin 1, so only two bins need the correction.
+
+ After: power of every bin and the strongest local maxima, in one pass.
+*/
+
+typedef struct
+{
+    int bin;
+    float power;
+} fft_peak_t;
+
+/*
+ out[i] = window[i] * (capture[i] - 128) for n samples
+ Returns the mean of the capture less 128, for fft_window_dc()
+*/
+float fft_window_u8(const uint8_t *capture, const float *window, int n, kiss_fft_scalar *out);
+
+// Takes offset * window_bins[k] off bins 0 and 1, as if the mean had been removed first
+void fft_window_dc(kiss_fft_cpx *spectrum, float offset, const kiss_fft_cpx *window_bins);
+
+/*
+ power[k] = |spectrum[k]|^2 for nbins bins, and the top_k strongest local maxima
+ from bin kmin up into peaks, strongest first. A peak at the top bin only needs
+ to be above its lower neighbour. Returns the number of peaks found
+*/
+int fft_power_peaks(const kiss_fft_cpx *spectrum, int nbins, int kmin, float *power, fft_peak_t *peaks, int top_k);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
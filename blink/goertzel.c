@@ -0,0 +1,180 @@
+#include <math.h>
+#include "goertzel.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define SEMITONE_SPACING 0.05946309f // 2^(1/12) - 1
+
+// Semitones from a fundamental to its 2nd, 3rd and 4th harmonics
+static const int harmonic_offset[GOERTZEL_HARMONICS] = {0, 12, 19, 24};
+
+// Power gain of the [1 3 3 1] / 8 low pass at f, in Hz at rate
+static float lowpass_gain(float f, float rate)
+{
+    float c = cosf((float)M_PI * f / rate);
+    return c * c * c * c * c * c;
+}
+
+void goertzel_init(goertzel_bank_t *bank, const float *frequencies, int num_keys, float fsamp, uint16_t scale_mask)
+{
+    bank->count = 0;
+    bank->stages = 1;
+    bank->num_keys = num_keys < GOERTZEL_MAX_NOTES ? num_keys : GOERTZEL_MAX_NOTES;
+
+    for (int k = 0; k < bank->num_keys; k++)
+    {
+        bank->filter[k] = -1;
+        float f = frequencies[k];
+        if (f <= 0 || f >= fsamp / 2 || !(scale_mask & (1u << (k % 12))))
+            continue;
+
+        // The lowest rate still 4 times the note, and the low passes on the way
+        int stage = 0;
+        float rate = fsamp;
+        float gain = 1;
+        while (stage < GOERTZEL_MAX_STAGE && rate / 2 >= 4 * f)
+        {
+            gain *= lowpass_gain(f, rate);
+            rate /= 2;
+            stage++;
+        }
+        int decimation = 1 << stage;
+
+        float block = GOERTZEL_RESOLUTION * rate / (f * SEMITONE_SPACING);
+        if (block < GOERTZEL_MIN_BLOCK)
+            block = GOERTZEL_MIN_BLOCK;
+        // A whole block, and the stage's delay, within GOERTZEL_MAX_BLOCK input samples
+        int max_block = (GOERTZEL_MAX_BLOCK - (decimation - 1)) / decimation;
+        if (block > max_block)
+            block = (float)max_block;
+
+        goertzel_filter_t *filter = &bank->filters[bank->count];
+        filter->coeff = 2 * cosf(2 * (float)M_PI * f / rate);
+        filter->block = (uint16_t)ceilf(block);
+        if (filter->block > max_block)
+            filter->block = (uint16_t)max_block;
+        // |X|^2 of a sine of mean square m over a block of b is m * b^2 / 2
+        filter->scale = 2 / (gain * filter->block * filter->block);
+        bank->key[bank->count] = k;
+        bank->filter[k] = bank->count;
+        filter->stage = (uint8_t)stage;
+        if (stage + 1 > bank->stages)
+            bank->stages = stage + 1;
+        bank->count++;
+    }
+
+    // Keys go up, so stages go down: stage m's filters are a run, lower m later
+    for (int m = 0; m <= GOERTZEL_MAX_STAGE + 1; m++)
+    {
+        int i = 0;
+        while (i < bank->count && bank->filters[i].stage >= m)
+            i++;
+        bank->stage_first[m] = i;
+    }
+    goertzel_reset(bank);
+}
+
+void goertzel_reset(goertzel_bank_t *bank)
+{
+    for (int i = 0; i < bank->count; i++)
+    {
+        goertzel_filter_t *filter = &bank->filters[i];
+        filter->s1 = 0;
+        filter->s2 = 0;
+        filter->n = 0;
+        filter->power = 0;
+    }
+    for (int m = 0; m < GOERTZEL_MAX_STAGE; m++)
+    {
+        goertzel_decimator_t *d = &bank->decimators[m];
+        d->x1 = d->x2 = d->x3 = 0;
+        d->odd = false;
+    }
+}
+
+// One sample at stage m's rate through its filters
+static bool update_stage(goertzel_bank_t *bank, int m, float sample)
+{
+    bool done = false;
+    for (int i = bank->stage_first[m + 1]; i < bank->stage_first[m]; i++)
+    {
+        goertzel_filter_t *filter = &bank->filters[i];
+        float s = sample + filter->coeff * filter->s1 - filter->s2;
+        filter->s2 = filter->s1;
+        filter->s1 = s;
+
+        if (++filter->n == filter->block)
+        {
+            float power = filter->s1 * filter->s1 + filter->s2 * filter->s2 - filter->coeff * filter->s1 * filter->s2;
+            filter->power = power * filter->scale;
+            filter->s1 = 0;
+            filter->s2 = 0;
+            filter->n = 0;
+            done = true;
+        }
+    }
+    return done;
+}
+
+bool goertzel_update(goertzel_bank_t *bank, float sample)
+{
+    bool done = false;
+    for (int m = 0;; m++)
+    {
+        done |= update_stage(bank, m, sample);
+        if (m + 1 >= bank->stages)
+            break;
+
+        // Every other sample goes on to the next stage, low passed
+        goertzel_decimator_t *d = &bank->decimators[m];
+        float out = (sample + 3 * (d->x1 + d->x2) + d->x3) * 0.125f;
+        d->x3 = d->x2;
+        d->x2 = d->x1;
+        d->x1 = sample;
+        d->odd = !d->odd;
+        if (d->odd)
+            break;
+        sample = out;
+    }
+    return done;
+}
+
+bool goertzel_update_u8(goertzel_bank_t *bank, const uint8_t *samples, int n)
+{
+    bool done = false;
+    for (int j = 0; j < n; j++)
+    {
+        done |= goertzel_update(bank, (float)samples[j] - 128);
+    }
+    return done;
+}
+
+int goertzel_detect(const goertzel_bank_t *bank)
+{
+    int best = -1;
+    float best_score = 0;
+    float max_power = 0;
+
+    for (int i = 0; i < bank->count; i++)
+    {
+        if (bank->filters[i].power > max_power)
+            max_power = bank->filters[i].power;
+
+        float score = 0;
+        for (int h = 0; h < GOERTZEL_HARMONICS; h++)
+        {
+            int k = bank->key[i] + harmonic_offset[h];
+            if (k < bank->num_keys && bank->filter[k] >= 0)
+                score += bank->filters[bank->filter[k]].power;
+        }
+        if (score > best_score)
+        {
+            best_score = score;
+            best = bank->key[i];
+        }
+    }
+
+    return max_power < GOERTZEL_MIN_POWER ? -1 : best;
+}
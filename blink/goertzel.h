@@ -0,0 +1,105 @@
+#ifndef GOERTZEL_H
+#define GOERTZEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Note detection with a bank of Goertzel filters, one per note of the frequency
+ table, instead of a full spectrum. Only notes below Nyquist and in the scale
+ mask get a filter, so a scale of 7 notes costs 7/12 of the chromatic bank.
+
+ Each filter runs with its own block length: long enough to tell a note from
+ its neighbours a semitone away, up to GOERTZEL_MAX_BLOCK input samples. High
+ notes complete a block every few milliseconds, low ones every 64ms at 8kHz, and
+ each filter's power is updated as soon as its own block is done. Below about
+ 120Hz the cap is shorter than a semitone needs, so the lowest notes lean on
+ the harmonic scoring below to land on the right key.
+
+ Low notes don't need the full sample rate. The input is low passed and halved
+ octave by octave, up to GOERTZEL_MAX_STAGE times, and each filter runs at the
+ lowest rate still at least 4 times its note, where the [1 3 3 1] low pass has
+ it within 2dB (corrected for) and its images down 25dB or more. Every octave
+ down costs half the filter updates, so the notes above fsamp / 8 are most of
+ the bank's time.
+
+ The detected note is the one whose first GOERTZEL_HARMONICS harmonics carry the
+ most power, which keeps a strong second harmonic from winning.
+*/
+
+#define GOERTZEL_MAX_NOTES 120
+#ifndef GOERTZEL_MAX_BLOCK
+#define GOERTZEL_MAX_BLOCK 512 // Input samples, the FFT engine's window
+#endif
+#define GOERTZEL_MIN_BLOCK 32
+#define GOERTZEL_MAX_STAGE 6 // Lowest rate fsamp / 2^GOERTZEL_MAX_STAGE
+
+// Block length as a multiple of the minimum that separates neighbouring notes,
+// fsamp / (f * (2^(1/12) - 1)). Lower reacts faster but lets neighbours through
+#define GOERTZEL_RESOLUTION 1.0f
+
+#define GOERTZEL_HARMONICS 4
+
+// Mean square power per note, in 8 bit ADC counts, below which nothing is detected
+#define GOERTZEL_MIN_POWER 1.0f
+
+// Bit n enables every note whose index in the frequency table is n mod 12
+#define GOERTZEL_ALL_NOTES 0xFFF
+
+typedef struct
+{
+    float coeff; // 2cos(2 pi f / rate), at its stage's rate
+    float s1, s2;
+    uint16_t block; // In samples at its stage's rate
+    uint16_t n;
+    uint8_t stage;  // Runs at fsamp / 2^stage
+    float scale; // |X|^2 of a block to the mean square at the input, low pass droop included
+    float power; // Of the last completed block
+} goertzel_filter_t;
+
+// Low pass and halve between two stages
+typedef struct
+{
+    float x1, x2, x3; // Previous inputs, newest first
+    bool odd;         // An output is due on the next input
+} goertzel_decimator_t;
+
+typedef struct
+{
+    int count;
+    int stages;                               // Stages in use, 0 runs at fsamp
+    int stage_first[GOERTZEL_MAX_STAGE + 2];  // Filters of stage m are [stage_first[m + 1], stage_first[m])
+    goertzel_decimator_t decimators[GOERTZEL_MAX_STAGE];
+    uint8_t key[GOERTZEL_MAX_NOTES];     // Index into the frequency table of each filter
+    int8_t filter[GOERTZEL_MAX_NOTES];   // Filter of each key, -1 when it has none
+    int num_keys;
+    goertzel_filter_t filters[GOERTZEL_MAX_NOTES];
+} goertzel_bank_t;
+
+/*
+ Tunes a filter to every key in frequencies[0..num_keys) below fsamp / 2 whose
+ bit is set in scale_mask
+*/
+void goertzel_init(goertzel_bank_t *bank, const float *frequencies, int num_keys, float fsamp, uint16_t scale_mask);
+
+// Clears every filter's state and power, the tuning is kept
+void goertzel_reset(goertzel_bank_t *bank);
+
+// One sample through the bank, each filter at its own stage's rate. Returns
+// true when any of them completed a block
+bool goertzel_update(goertzel_bank_t *bank, float sample);
+
+// n samples from the 8 bit capture, centred on 128
+bool goertzel_update_u8(goertzel_bank_t *bank, const uint8_t *samples, int n);
+
+// Key with the most harmonic power from the latest blocks, or -1 below GOERTZEL_MIN_POWER
+int goertzel_detect(const goertzel_bank_t *bank);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,3 @@
+/* kiss_fft.c built as the FIXED_POINT variant named in kiss_fft_fixed.h */
+#include "kiss_fft_fixed.h"
+#include "kiss_fft.c"
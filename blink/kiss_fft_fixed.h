@@ -0,0 +1,40 @@
+#ifndef KISS_FFT_FIXED_H
+#define KISS_FFT_FIXED_H
+
+/*
+ Fixed point build of kiss_fft and kiss_fftr under their own names, so a 16 and a
+ 32 bit build can be linked next to the float one. Define FIXED_POINT as 16 or 32
+ before including, every public symbol gets a _s16 or _s32 suffix.
+
+ Only include this from translation units that deal in fixed point types, the
+ float kiss_fft.h can't be included in the same file.
+*/
+
+#include <stdint.h>
+
+#if !defined(FIXED_POINT) || (FIXED_POINT != 16 && FIXED_POINT != 32)
+#error "Define FIXED_POINT as 16 or 32 before including kiss_fft_fixed.h"
+#endif
+
+#if FIXED_POINT == 32
+#define KISS_FIXED_NAME(name) name##_s32
+#else
+#define KISS_FIXED_NAME(name) name##_s16
+#endif
+
+#define kiss_fft_state KISS_FIXED_NAME(kiss_fft_state)
+#define kiss_fftr_state KISS_FIXED_NAME(kiss_fftr_state)
+#define kiss_fft_alloc KISS_FIXED_NAME(kiss_fft_alloc)
+#define kiss_fft KISS_FIXED_NAME(kiss_fft)
+#define kiss_fft_stride KISS_FIXED_NAME(kiss_fft_stride)
+#define kiss_fft_cleanup KISS_FIXED_NAME(kiss_fft_cleanup)
+#define kiss_fft_next_fast_size KISS_FIXED_NAME(kiss_fft_next_fast_size)
+#define kf_work KISS_FIXED_NAME(kf_work)
+#define kf_factor KISS_FIXED_NAME(kf_factor)
+#define kiss_fftr_alloc KISS_FIXED_NAME(kiss_fftr_alloc)
+#define kiss_fftr KISS_FIXED_NAME(kiss_fftr)
+#define kiss_fftri KISS_FIXED_NAME(kiss_fftri)
+
+#include "kiss_fftr.h"
+
+#endif
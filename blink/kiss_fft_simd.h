@@ -0,0 +1,35 @@
+#ifndef KISS_FFT_SIMD_H
+#define KISS_FFT_SIMD_H
+
+/*
+ USE_SIMD build of kiss_fft and kiss_fftr under their own names, so it can be
+ linked next to the float one. kiss_fft_scalar is an SSE __m128 and each lane
+ carries an independent transform, four per call. Every public symbol gets an
+ _x4 suffix.
+
+ x86 host builds only. Only include this from translation units that deal in
+ __m128 scalars, the float kiss_fft.h can't be included in the same file.
+*/
+
+#ifndef USE_SIMD
+#define USE_SIMD
+#endif
+
+#define KISS_SIMD_NAME(name) name##_x4
+
+#define kiss_fft_state KISS_SIMD_NAME(kiss_fft_state)
+#define kiss_fftr_state KISS_SIMD_NAME(kiss_fftr_state)
+#define kiss_fft_alloc KISS_SIMD_NAME(kiss_fft_alloc)
+#define kiss_fft KISS_SIMD_NAME(kiss_fft)
+#define kiss_fft_stride KISS_SIMD_NAME(kiss_fft_stride)
+#define kiss_fft_cleanup KISS_SIMD_NAME(kiss_fft_cleanup)
+#define kiss_fft_next_fast_size KISS_SIMD_NAME(kiss_fft_next_fast_size)
+#define kf_work KISS_SIMD_NAME(kf_work)
+#define kf_factor KISS_SIMD_NAME(kf_factor)
+#define kiss_fftr_alloc KISS_SIMD_NAME(kiss_fftr_alloc)
+#define kiss_fftr KISS_SIMD_NAME(kiss_fftr)
+#define kiss_fftri KISS_SIMD_NAME(kiss_fftri)
+
+#include "kiss_fftr.h"
+
+#endif
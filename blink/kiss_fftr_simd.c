@@ -0,0 +1,3 @@
+/* kiss_fftr.c built as the USE_SIMD variant named in kiss_fft_simd.h */
+#include "kiss_fft_simd.h"
+#include "kiss_fftr.c"
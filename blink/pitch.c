@@ -0,0 +1,219 @@
+#include "pitch.h"
+#include "fft_kernels.h"
+
+static int pitch_interp = PITCH_INTERP;
+
+void pitch_set_interp(int interp)
+{
+    pitch_interp = interp;
+}
+
+float pitch_interpolate_peak(const kiss_fft_cpx *spectrum, const float *power, int nbins, int k)
+{
+    if (k <= 0 || k >= nbins - 1)
+        return (float)k;
+
+    if (pitch_interp == PITCH_INTERP_PARABOLIC)
+    {
+        float a = logf(power[k - 1] + 1e-20f);
+        float b = logf(power[k] + 1e-20f);
+        float c = logf(power[k + 1] + 1e-20f);
+        float denom = a - 2 * b + c;
+        if (denom >= 0)
+            return (float)k;
+        return k + 0.5f * (a - c) / denom;
+    }
+    if (pitch_interp == PITCH_INTERP_QUINN)
+    {
+        // Real parts of X[k-1]/X[k] and X[k+1]/X[k]
+        float re = spectrum[k].r;
+        float im = spectrum[k].i;
+        float mag = re * re + im * im;
+        if (mag == 0)
+            return (float)k;
+        float ap = (spectrum[k + 1].r * re + spectrum[k + 1].i * im) / mag;
+        float am = (spectrum[k - 1].r * re + spectrum[k - 1].i * im) / mag;
+        float dp = -ap / (1 - ap);
+        float dm = am / (1 - am);
+        float d = (dp > 0 && dm > 0) ? dp : dm;
+        if (d > 0.5f || d < -0.5f)
+            return (float)k;
+        return k + d;
+    }
+    return (float)k;
+}
+
+// Index of the largest power in bins [lo, hi]
+static int peak_in_range(const float *power, int nbins, int lo, int hi)
+{
+    if (lo < 1)
+        lo = 1;
+    if (hi > nbins - 1)
+        hi = nbins - 1;
+
+    int best = lo;
+    for (int k = lo + 1; k <= hi; k++)
+    {
+        if (power[k] > power[best])
+            best = k;
+    }
+    return best;
+}
+
+int pitch_fft_kmin(int nfft, float fsamp)
+{
+    int kmin = (int)(PITCH_FMIN * nfft / fsamp);
+    return kmin < 1 ? 1 : kmin;
+}
+
+float pitch_fft_estimate(const kiss_fft_cpx *spectrum, int nfft, float fsamp, float *power)
+{
+    // any frequency bin over nfft/2 is aliased (nyquist sampling theorum)
+    int nbins = nfft / 2 + 1;
+    float bin_hz = fsamp / nfft;
+    int kmin = pitch_fft_kmin(nfft, fsamp);
+
+    // Power and the strongest peaks in one pass
+    fft_peak_t peaks[PITCH_PEAKS];
+    int npeaks = fft_power_peaks(spectrum, nbins, kmin, power, peaks, PITCH_PEAKS);
+    if (npeaks == 0)
+        return 0;
+    float max_power = peaks[0].power;
+
+    // Harmonic product spectrum, normalised so the product can't overflow, over
+    // the bins next to a strong enough peak
+    int kmax = (nbins - 1) / PITCH_HPS_HARMONICS;
+    float best_hps = 0;
+    int best_k = kmin;
+    for (int p = 0; p < npeaks && peaks[p].power >= PITCH_MIN_FUNDAMENTAL * max_power; p++)
+    {
+        for (int k = peaks[p].bin - 1; k <= peaks[p].bin + 1; k++)
+        {
+            if (k < kmin || k > kmax)
+                continue;
+
+            // A fundamental anywhere in bin k puts harmonic h within h/2 bins of h * k
+            float hps = 1;
+            for (int h = 1; h <= PITCH_HPS_HARMONICS; h++)
+            {
+                hps *= power[peak_in_range(power, nbins, h * k - h / 2, h * k + h / 2)] / max_power;
+            }
+            if (hps > best_hps)
+            {
+                best_hps = hps;
+                best_k = k;
+            }
+        }
+    }
+
+    // Refine harmonic by harmonic, each one predicted from the estimate so far.
+    // Harmonic h pins the fundamental h times tighter, so it is weighted by h^2
+    int k = peak_in_range(power, nbins, best_k - 1, best_k + 1);
+    float fundamental = pitch_interpolate_peak(spectrum, power, nbins, k);
+    float sum = fundamental * power[k];
+    float weight = power[k];
+    for (int h = 2; h <= PITCH_HPS_HARMONICS; h++)
+    {
+        int predicted = (int)(h * fundamental + 0.5f);
+        if (predicted >= nbins - 1)
+            break;
+
+        k = peak_in_range(power, nbins, predicted - 1, predicted + 1);
+        float w = power[k] * h * h;
+        sum += w * pitch_interpolate_peak(spectrum, power, nbins, k) / h;
+        weight += w;
+        fundamental = sum / weight;
+    }
+
+    return fundamental * bin_hz;
+}
+
+static int peak_in_range_u32(const uint32_t *power, int nbins, int lo, int hi)
+{
+    if (lo < 1)
+        lo = 1;
+    if (hi > nbins - 1)
+        hi = nbins - 1;
+
+    int best = lo;
+    for (int k = lo + 1; k <= hi; k++)
+    {
+        if (power[k] > power[best])
+            best = k;
+    }
+    return best;
+}
+
+// pitch_interpolate_peak() on bins k - 1 to k + 1, the only ones it reads
+static float interpolate_u32(const uint32_t *power, int nbins, int k, pitch_bin_fn bin, const void *ctx)
+{
+    if (k <= 0 || k >= nbins - 1)
+        return (float)k;
+
+    kiss_fft_cpx spectrum[3];
+    float near_power[3];
+    for (int i = 0; i < 3; i++)
+    {
+        float re_im[2];
+        bin(ctx, k - 1 + i, re_im);
+        spectrum[i].r = re_im[0];
+        spectrum[i].i = re_im[1];
+        near_power[i] = (float)power[k - 1 + i];
+    }
+    return k - 1 + pitch_interpolate_peak(spectrum, near_power, 3, 1);
+}
+
+// The steps of pitch_fft_estimate(), with the bin searches in integer
+float pitch_fft_estimate_u32(const uint32_t *power, int nfft, float fsamp, const int *peaks, int npeaks,
+                             pitch_bin_fn bin, const void *ctx)
+{
+    int nbins = nfft / 2 + 1;
+    float bin_hz = fsamp / nfft;
+    int kmin = pitch_fft_kmin(nfft, fsamp);
+    if (npeaks == 0)
+        return 0;
+    float max_power = (float)power[peaks[0]];
+    uint32_t min_fundamental = (uint32_t)(PITCH_MIN_FUNDAMENTAL * max_power);
+
+    int kmax = (nbins - 1) / PITCH_HPS_HARMONICS;
+    float best_hps = 0;
+    int best_k = kmin;
+    for (int p = 0; p < npeaks && power[peaks[p]] >= min_fundamental; p++)
+    {
+        for (int k = peaks[p] - 1; k <= peaks[p] + 1; k++)
+        {
+            if (k < kmin || k > kmax)
+                continue;
+
+            float hps = 1;
+            for (int h = 1; h <= PITCH_HPS_HARMONICS; h++)
+            {
+                hps *= power[peak_in_range_u32(power, nbins, h * k - h / 2, h * k + h / 2)] / max_power;
+            }
+            if (hps > best_hps)
+            {
+                best_hps = hps;
+                best_k = k;
+            }
+        }
+    }
+
+    int k = peak_in_range_u32(power, nbins, best_k - 1, best_k + 1);
+    float fundamental = interpolate_u32(power, nbins, k, bin, ctx);
+    float sum = fundamental * power[k];
+    float weight = (float)power[k];
+    for (int h = 2; h <= PITCH_HPS_HARMONICS; h++)
+    {
+        int predicted = (int)(h * fundamental + 0.5f);
+        if (predicted >= nbins - 1)
+            break;
+
+        k = peak_in_range_u32(power, nbins, predicted - 1, predicted + 1);
+        float w = (float)power[k] * h * h;
+        sum += w * interpolate_u32(power, nbins, k, bin, ctx) / h;
+        weight += w;
+        fundamental = sum / weight;
+    }
+
+    return fundamental * bin_hz;
+}
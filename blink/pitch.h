@@ -0,0 +1,87 @@
+#ifndef PITCH_H
+#define PITCH_H
+
+#include <stdint.h>
+#include "kiss_fft.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Pitch estimation from the spectrum of a real FFT (kiss_fftr output).
+
+ The fundamental is picked with a harmonic product spectrum, which multiplies
+ the power at k, 2k, .. PITCH_HPS_HARMONICS*k so the fundamental wins over a
+ louder harmonic. The peak of every harmonic is then interpolated between
+ bins, and each harmonic's estimate divided by its number, so the error in the
+ result shrinks with the harmonic number.
+ */
+
+// Number of harmonics multiplied in the HPS, 1 = plain argmax
+#ifndef PITCH_HPS_HARMONICS
+#define PITCH_HPS_HARMONICS 4
+#endif
+
+// Sub-bin peak interpolation, the default until pitch_set_interp() changes it
+// 0 = None, raw bin
+// 1 = Parabola through the log power of the peak and its neighbours, for windowed input
+// 2 = Quinn's first estimator on the complex bins, for rectangular (unwindowed) input
+#define PITCH_INTERP_NONE 0
+#define PITCH_INTERP_PARABOLIC 1
+#define PITCH_INTERP_QUINN 2
+#ifndef PITCH_INTERP
+#define PITCH_INTERP PITCH_INTERP_QUINN
+#endif
+
+// A fundamental candidate needs a local maximum within a bin holding at least this
+// fraction of the strongest peak's power. Sub-harmonics only see the leakage slope
+// of the real fundamental, so this keeps the HPS from dropping an octave
+#ifndef PITCH_MIN_FUNDAMENTAL
+#define PITCH_MIN_FUNDAMENTAL 0.02f
+#endif
+
+// Strongest local maxima the fundamental is looked for around, the HPS only
+// tries the bins next to these rather than the whole spectrum
+#ifndef PITCH_PEAKS
+#define PITCH_PEAKS 8
+#endif
+
+// Lowest frequency considered, bins below it are ignored
+#ifndef PITCH_FMIN
+#define PITCH_FMIN 25.0f
+#endif
+
+/*
+ spectrum has nfft/2+1 complex points
+ power is a work buffer of nfft/2+1 floats, left holding the power spectrum
+ Returns the estimated fundamental in Hz, or 0 for silence
+*/
+float pitch_fft_estimate(const kiss_fft_cpx *spectrum, int nfft, float fsamp, float *power);
+
+// Complex value of bin k as an r,i pair, at any scale, fetched on demand
+typedef void (*pitch_bin_fn)(const void *ctx, int k, float *re_im);
+
+/*
+ pitch_fft_estimate() for a spectrum that stays in integer, from
+ fft_s16_power_peaks() or fft_s32_power_peaks() (fft_fixed.h): power has
+ nfft/2+1 bins, peaks the npeaks strongest local maxima found from
+ pitch_fft_kmin() up. Float only comes in per HPS candidate and for the few
+ bins interpolated, which bin() converts with ctx
+*/
+float pitch_fft_estimate_u32(const uint32_t *power, int nfft, float fsamp, const int *peaks, int npeaks,
+                             pitch_bin_fn bin, const void *ctx);
+
+// Lowest bin considered, from PITCH_FMIN
+int pitch_fft_kmin(int nfft, float fsamp);
+
+// One of the PITCH_INTERP_ modes, for windowed or unwindowed input
+void pitch_set_interp(int interp);
+
+// Fractional bin of the peak at bin k, interpolated from its neighbours
+float pitch_interpolate_peak(const kiss_fft_cpx *spectrum, const float *power, int nbins, int k);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
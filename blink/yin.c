@@ -0,0 +1,99 @@
+#include "yin.h"
+
+static float difference_f32(const float *x, int tau)
+{
+    float sum = 0;
+    for (int j = 0; j < YIN_WINDOW; j++)
+    {
+        float delta = x[j] - x[j + tau];
+        sum += delta * delta;
+    }
+    return sum;
+}
+
+float yin_estimate(const float *x)
+{
+    // Normalised difference of the previous two lags, kept for the dip search and interpolation
+    float running_sum = 0;
+    float prev = 1;
+    float prev2 = 1;
+    int dip = 0;
+
+    for (int tau = 1; tau <= YIN_TAU_MAX; tau++)
+    {
+        float d = difference_f32(x, tau);
+        running_sum += d;
+        float norm = running_sum > 0 ? d * tau / running_sum : 1;
+
+        if (dip)
+        {
+            // Walk to the bottom of the dip, then stop
+            if (norm >= prev)
+            {
+                // Parabola through the three lags around the minimum
+                float denom = prev2 - 2 * prev + norm;
+                float shift = denom > 0 ? 0.5f * (prev2 - norm) / denom : 0;
+                return YIN_FSAMP / (tau - 1 + shift);
+            }
+        }
+        else if (tau >= YIN_TAU_MIN && norm * YIN_THRESHOLD_DEN < YIN_THRESHOLD_NUM)
+            dip = 1;
+
+        prev2 = prev;
+        prev = norm;
+    }
+
+    return 0;
+}
+
+static uint32_t difference_u8(const uint8_t *x, int tau)
+{
+    uint32_t sum = 0;
+    for (int j = 0; j < YIN_WINDOW; j++)
+    {
+        int delta = x[j] - x[j + tau];
+        sum += delta * delta;
+    }
+    return sum;
+}
+
+int32_t yin_estimate_u8(const uint8_t *x)
+{
+    // The normalised difference d * tau / sum is compared without dividing,
+    // by keeping numerator and denominator apart
+    uint64_t running_sum = 0;
+    uint64_t prev_num = 1, prev_den = 1;
+    int dip = 0;
+
+    for (int tau = 1; tau <= YIN_TAU_MAX; tau++)
+    {
+        uint32_t d = difference_u8(x, tau);
+        running_sum += d;
+        uint64_t num = running_sum > 0 ? (uint64_t)d * tau : 1;
+        uint64_t den = running_sum > 0 ? running_sum : 1;
+
+        if (dip)
+        {
+            // num / den >= prev_num / prev_den, at the bottom of the dip
+            if (num * prev_den >= prev_num * den)
+            {
+                // Interpolate on the raw difference around the minimum, in Q8 lags
+                int64_t a = difference_u8(x, tau - 2);
+                int64_t b = difference_u8(x, tau - 1);
+                int64_t c = d;
+                int64_t denom = a - 2 * b + c;
+                int64_t period_q8 = (int64_t)(tau - 1) << 8;
+                if (denom > 0)
+                    period_q8 += (a - c) * 128 / denom;
+                return (int32_t)(((int64_t)YIN_FSAMP << 24) / period_q8);
+            }
+        }
+        else if (tau >= YIN_TAU_MIN && num * YIN_THRESHOLD_DEN < YIN_THRESHOLD_NUM * den)
+            dip = 1;
+
+        prev_num = num;
+        prev_den = den;
+    }
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+#ifndef YIN_H
+#define YIN_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Time domain pitch detection (YIN, de Cheveigne & Kawahara 2002).
+
+ The difference function d(tau) = sum (x[j] - x[j + tau])^2 over a window of
+ YIN_WINDOW samples is normalised by its running mean, and the first lag that
+ dips below YIN_THRESHOLD is the period. Lags are evaluated in order and the
+ search stops at the bottom of that first dip, so a high note costs a fraction
+ of a low one. The difference function ignores DC, so no mean removal is needed.
+
+ Input needs YIN_WINDOW + YIN_TAU_MAX samples, 400 at the defaults below
+ (50ms at 8kHz) against 2048 for the FFT path.
+*/
+
+#ifndef YIN_FSAMP
+#define YIN_FSAMP 8000
+#endif
+
+// Lowest detectable frequency sets the longest lag
+#ifndef YIN_FMIN
+#define YIN_FMIN 40
+#endif
+
+// Highest detectable frequency sets the shortest lag
+#ifndef YIN_FMAX
+#define YIN_FMAX 2000
+#endif
+
+#define YIN_TAU_MIN (YIN_FSAMP / YIN_FMAX)
+#define YIN_TAU_MAX (YIN_FSAMP / YIN_FMIN)
+#define YIN_WINDOW YIN_TAU_MAX
+#define YIN_NSAMP (YIN_WINDOW + YIN_TAU_MAX)
+
+// Dip threshold on the normalised difference, as a fraction
+#define YIN_THRESHOLD_NUM 15
+#define YIN_THRESHOLD_DEN 100
+
+/*
+ x has YIN_NSAMP samples
+ Returns the fundamental in Hz, or 0 when no lag dips below the threshold
+*/
+float yin_estimate(const float *x);
+
+/*
+ Integer version for cores without an FPU, straight from the 8 bit ADC capture.
+ Sums stay within 32 bits for YIN_WINDOW up to 33000, the normalisation test is 64 bit.
+ Returns the fundamental in Hz as Q16.16, or 0
+*/
+int32_t yin_estimate_u8(const uint8_t *x);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
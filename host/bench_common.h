@@ -0,0 +1,58 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+// Shared helpers for the host benchmarks: test signals shaped like the blink
+// ADC capture, wall clock and cycle counters
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_CYCLES 1
+static inline uint64_t bench_cycles(void) { return __rdtsc(); }
+#else
+#define BENCH_HAVE_CYCLES 0
+static inline uint64_t bench_cycles(void) { return 0; }
+#endif
+
+#define BENCH_FSAMP 8000.0
+#define BENCH_FREQ_0V 27.5 // Same note table as blink.c
+
+static inline double bench_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Band limited sawtooth at freq Hz around mid scale, amplitude in ADC counts,
+// with +-noise counts of uniform noise, quantized to 8 bits like the ADC FIFO
+static inline void bench_sawtooth_u8(uint8_t *out, int n, double freq, double phase, double amplitude, int noise)
+{
+    for (int i = 0; i < n; i++)
+    {
+        double t = freq * i / BENCH_FSAMP + phase;
+        double s = 0;
+        for (int h = 1; h * freq < BENCH_FSAMP / 2; h++)
+        {
+            s += sin(2 * M_PI * h * t) / h;
+        }
+        double v = 128 + amplitude * 2 / M_PI * s;
+        if (noise)
+            v += rand() % (2 * noise + 1) - noise;
+        out[i] = (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+    }
+}
+
+// Signed distance from the true frequency in cents
+static inline double bench_cents(double estimate, double truth)
+{
+    if (estimate <= 0)
+        return 1e9;
+    return 1200 * log2(estimate / truth);
+}
+
+#endif
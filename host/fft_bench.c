@@ -0,0 +1,365 @@
+// Host benchmark of the blink FFT builds: the float kiss_fftr against the 16 and
+// 32 bit fixed point ones fed straight from the 8 bit capture.
+//
+//   cmake -S host -B host/build && cmake --build host/build && host/build/fft_bench
+
+#include <stdio.h>
+#include <string.h>
+#include "bench_common.h"
+#include "kiss_fftr.h"
+#include "fft_fixed.h"
+#include "fft_plan_512.h"
+#include "fft_kernels.h"
+#if FFT_BENCH_SIMD
+#include "fft_batch.h"
+#endif
+#include "pitch.h"
+
+#define NFFT_MAX 2048
+#define NOTE_FIRST 7 // E1, 41.2Hz
+#define NOTE_LAST 63 // C6, 1046.5Hz
+#define NOTES (NOTE_LAST - NOTE_FIRST + 1)
+#define PHASES 2
+#define REPEATS 20
+
+static uint8_t signals[NOTES * PHASES][NFFT_MAX];
+static kiss_fft_cpx reference[NOTES * PHASES][NFFT_MAX / 2 + 1];
+static kiss_fft_scalar fft_in[NFFT_MAX];
+static kiss_fft_cpx fft_out[NFFT_MAX / 2 + 1];
+static float power[NFFT_MAX / 2 + 1];
+
+// The blink float path: remove the mean, convert, transform
+static void float_u8(kiss_fftr_cfg cfg, int nfft, const uint8_t *capture, kiss_fft_cpx *out)
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < nfft; i++)
+        sum += capture[i];
+    float avg = (float)sum / nfft;
+    for (int i = 0; i < nfft; i++)
+        fft_in[i] = capture[i] - avg;
+    kiss_fftr(cfg, fft_in, out);
+}
+
+static int peak_bin(const kiss_fft_cpx *spectrum, int nfft)
+{
+    int best = 1;
+    float best_power = 0;
+    for (int k = 1; k <= nfft / 2; k++)
+    {
+        float p = spectrum[k].r * spectrum[k].r + spectrum[k].i * spectrum[k].i;
+        if (p > best_power)
+        {
+            best_power = p;
+            best = k;
+        }
+    }
+    return best;
+}
+
+typedef struct
+{
+    double signal;
+    double noise;
+    int peak_agree;
+    int pitch_agree;
+} accuracy_t;
+
+// Compares one spectrum against the float reference, DC excluded
+static void compare(accuracy_t *acc, const kiss_fft_cpx *test, const kiss_fft_cpx *ref, int nfft)
+{
+    for (int k = 1; k <= nfft / 2; k++)
+    {
+        double dr = test[k].r - ref[k].r;
+        double di = test[k].i - ref[k].i;
+        acc->signal += (double)ref[k].r * ref[k].r + (double)ref[k].i * ref[k].i;
+        acc->noise += dr * dr + di * di;
+    }
+    acc->peak_agree += peak_bin(test, nfft) == peak_bin(ref, nfft);
+
+    float f_test = pitch_fft_estimate(test, nfft, BENCH_FSAMP, power);
+    float f_ref = pitch_fft_estimate(ref, nfft, BENCH_FSAMP, power);
+    acc->pitch_agree += fabs(bench_cents(f_test, f_ref)) < 50;
+}
+
+static void print_row(const char *name, int nfft, const accuracy_t *acc, double seconds, uint64_t cycles)
+{
+    int n = NOTES * PHASES;
+    printf("%-8s %6d %9.1fdB %9.1f%% %9.1f%% %11.2f %12.0f\n", name, nfft,
+           acc ? 10 * log10(acc->signal / acc->noise) : INFINITY,
+           acc ? 100.0 * acc->peak_agree / n : 100.0, acc ? 100.0 * acc->pitch_agree / n : 100.0,
+           seconds * 1e6 / (REPEATS * n), BENCH_HAVE_CYCLES ? (double)cycles / (REPEATS * n) : 0);
+}
+
+static void fixed_point_bench(void)
+{
+    static kiss_fft_cpx test[NFFT_MAX / 2 + 1];
+    static const int sizes[] = {256, 512, 1024, 2048};
+    int n = NOTES * PHASES;
+
+    printf("Float vs fixed point kiss_fftr from the 8 bit capture, %d frames per size\n", n);
+    printf("SNR and agreement are against the float spectrum, time includes input conversion\n\n");
+    printf("%-8s %6s %11s %10s %10s %11s %12s\n", "build", "nfft", "SNR", "peak bin", "pitch", "us/frame", "cycles/frame");
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        int nfft = sizes[s];
+        kiss_fftr_cfg cfg = kiss_fftr_alloc(nfft, 0, NULL, NULL);
+        fft_s16_cfg cfg16 = fft_s16_alloc(nfft);
+        fft_s32_cfg cfg32 = fft_s32_alloc(nfft);
+
+        for (int i = 0; i < n; i++)
+            float_u8(cfg, nfft, signals[i], reference[i]);
+
+        double start = bench_seconds();
+        uint64_t start_cycles = bench_cycles();
+        for (int r = 0; r < REPEATS; r++)
+            for (int i = 0; i < n; i++)
+                float_u8(cfg, nfft, signals[i], fft_out);
+        print_row("float", nfft, NULL, bench_seconds() - start, bench_cycles() - start_cycles);
+
+        accuracy_t acc16 = {0};
+        for (int i = 0; i < n; i++)
+        {
+            fft_s16_u8(cfg16, signals[i], (float *)test);
+            compare(&acc16, test, reference[i], nfft);
+        }
+        start = bench_seconds();
+        start_cycles = bench_cycles();
+        for (int r = 0; r < REPEATS; r++)
+            for (int i = 0; i < n; i++)
+                fft_s16_u8(cfg16, signals[i], (float *)test);
+        print_row("s16", nfft, &acc16, bench_seconds() - start, bench_cycles() - start_cycles);
+
+        accuracy_t acc32 = {0};
+        for (int i = 0; i < n; i++)
+        {
+            fft_s32_u8(cfg32, signals[i], (float *)test);
+            compare(&acc32, test, reference[i], nfft);
+        }
+        start = bench_seconds();
+        start_cycles = bench_cycles();
+        for (int r = 0; r < REPEATS; r++)
+            for (int i = 0; i < n; i++)
+                fft_s32_u8(cfg32, signals[i], (float *)test);
+        print_row("s32", nfft, &acc32, bench_seconds() - start, bench_cycles() - start_cycles);
+
+        kiss_fftr_free(cfg);
+        fft_s16_free(cfg16);
+        fft_s32_free(cfg32);
+    }
+}
+
+// The generated const plan has to give exactly what kiss_fftr_alloc() builds
+static void static_plan_bench(void)
+{
+    static kiss_fft_cpx test[NFFT_MAX / 2 + 1];
+    const int nfft = FFT_PLAN_512_NFFT;
+    int n = NOTES * PHASES;
+
+    double start = bench_seconds();
+    kiss_fftr_cfg cfg = kiss_fftr_alloc(nfft, 0, NULL, NULL);
+    double alloc_seconds = bench_seconds() - start;
+
+    size_t plan_bytes = 0;
+    kiss_fftr_alloc(nfft, 0, NULL, &plan_bytes);
+
+    int identical = 0;
+    for (int i = 0; i < n; i++)
+    {
+        float_u8(cfg, nfft, signals[i], reference[i]);
+        float_u8(fft_plan_512, nfft, signals[i], test);
+        identical += memcmp(test, reference[i], sizeof(kiss_fft_cpx) * (nfft / 2 + 1)) == 0;
+    }
+
+    printf("\nStatic plan for %d points: %d of %d spectra bit identical to kiss_fftr_alloc()\n", nfft, identical, n);
+    printf("kiss_fftr_alloc() takes %0.1fus and %zu bytes of heap at startup\n", alloc_seconds * 1e6, plan_bytes);
+    kiss_fftr_free(cfg);
+}
+
+// Separate passes as the blink loop had them, plus the window as a third pass
+static void window_passes(const uint8_t *capture, int nfft, kiss_fft_scalar *out)
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < nfft; i++)
+        sum += capture[i];
+    float avg = (float)sum / nfft;
+    for (int i = 0; i < nfft; i++)
+        out[i] = capture[i] - avg;
+    for (int i = 0; i < nfft; i++)
+        out[i] *= fft_plan_512_window[i];
+}
+
+static int power_peaks_passes(const kiss_fft_cpx *spectrum, int nbins, float *power, fft_peak_t *peaks, int top_k)
+{
+    for (int k = 0; k < nbins; k++)
+        power[k] = spectrum[k].r * spectrum[k].r + spectrum[k].i * spectrum[k].i;
+
+    int count = 0;
+    for (int k = 1; k < nbins; k++)
+    {
+        if (power[k] < power[k - 1] || (k + 1 < nbins && power[k] < power[k + 1]) || power[k] == 0)
+            continue;
+        if (count == top_k && power[k] <= peaks[top_k - 1].power)
+            continue;
+        int i = count < top_k ? count++ : top_k - 1;
+        for (; i > 0 && peaks[i - 1].power < power[k]; i--)
+            peaks[i] = peaks[i - 1];
+        peaks[i].bin = k;
+        peaks[i].power = power[k];
+    }
+    return count;
+}
+
+// The fused kernels either side of the transform against separate passes over
+// the same buffers, bytes are what each version reads and writes
+static void fused_bench(void)
+{
+    static kiss_fft_scalar in_fused[NFFT_MAX], in_passes[NFFT_MAX];
+    static kiss_fft_cpx out_fused[NFFT_MAX / 2 + 1], out_passes[NFFT_MAX / 2 + 1];
+    static float power_passes[NFFT_MAX / 2 + 1];
+    const int nfft = FFT_PLAN_512_NFFT;
+    const int nbins = nfft / 2 + 1;
+    int n = NOTES * PHASES;
+    fft_peak_t peaks[PITCH_PEAKS], peaks_passes[PITCH_PEAKS];
+
+    // Same spectrum and peaks either way
+    double max_error = 0, max_value = 0;
+    int peaks_agree = 0;
+    for (int i = 0; i < n; i++)
+    {
+        window_passes(signals[i], nfft, in_passes);
+        kiss_fftr(fft_plan_512, in_passes, out_passes);
+        float offset = fft_window_u8(signals[i], fft_plan_512_window, nfft, in_fused);
+        kiss_fftr(fft_plan_512, in_fused, out_fused);
+        fft_window_dc(out_fused, offset, fft_plan_512_window_bins);
+        for (int k = 0; k < nbins; k++)
+        {
+            max_error = fmax(max_error, fabs(out_fused[k].r - out_passes[k].r) + fabs(out_fused[k].i - out_passes[k].i));
+            max_value = fmax(max_value, fabs(out_passes[k].r) + fabs(out_passes[k].i));
+        }
+
+        int count = fft_power_peaks(out_passes, nbins, 1, power, peaks, PITCH_PEAKS);
+        int count_passes = power_peaks_passes(out_passes, nbins, power_passes, peaks_passes, PITCH_PEAKS);
+        int same = count == count_passes;
+        for (int p = 0; p < count && same; p++)
+            same = peaks[p].bin == peaks_passes[p].bin;
+        peaks_agree += same;
+    }
+
+    double start = bench_seconds();
+    for (int r = 0; r < REPEATS * 10; r++)
+        for (int i = 0; i < n; i++)
+            window_passes(signals[i], nfft, in_passes);
+    double window_passes_s = bench_seconds() - start;
+
+    start = bench_seconds();
+    for (int r = 0; r < REPEATS * 10; r++)
+        for (int i = 0; i < n; i++)
+            fft_window_u8(signals[i], fft_plan_512_window, nfft, in_fused);
+    double window_fused_s = bench_seconds() - start;
+
+    start = bench_seconds();
+    for (int r = 0; r < REPEATS * 10; r++)
+        for (int i = 0; i < n; i++)
+            power_peaks_passes(out_passes, nbins, power_passes, peaks_passes, PITCH_PEAKS);
+    double peaks_passes_s = bench_seconds() - start;
+
+    start = bench_seconds();
+    for (int r = 0; r < REPEATS * 10; r++)
+        for (int i = 0; i < n; i++)
+            fft_power_peaks(out_passes, nbins, 1, power, peaks, PITCH_PEAKS);
+    double peaks_fused_s = bench_seconds() - start;
+
+    int frames = REPEATS * 10 * n;
+    printf("\nFused kernels at %d points, Hann window, top %d peaks\n", nfft, PITCH_PEAKS);
+    printf("Fused spectrum within %0.2g of the separate passes (relative), same peaks on %d of %d frames\n\n",
+           max_error / max_value, peaks_agree, n);
+    printf("%-22s %12s %12s %12s\n", "kernel", "bytes", "us/frame", "bytes saved");
+    // Sum: read capture. Mean: read capture, write input. Window: read input and window, write input
+    printf("%-22s %12d %12.3f\n", "window, 3 passes", 18 * nfft, window_passes_s * 1e6 / frames);
+    // Read capture and window, write input
+    printf("%-22s %12d %12.3f %11.0f%%\n", "window, fused", 9 * nfft, window_fused_s * 1e6 / frames, 100.0 * 9 / 18);
+    // Power: read spectrum, write power. Peaks: read power
+    printf("%-22s %12d %12.3f\n", "power+peaks, 2 passes", 16 * nbins, peaks_passes_s * 1e6 / frames);
+    // Read spectrum, write power
+    printf("%-22s %12d %12.3f %11.0f%%\n", "power+peaks, fused", 12 * nbins, peaks_fused_s * 1e6 / frames, 100.0 * 4 / 16);
+}
+
+#if FFT_BENCH_SIMD
+// Four frames per fft_x4_real() call against four float kiss_fftr calls,
+// including the lane packing, on float input as the offline tools have it
+static void simd_bench(void)
+{
+    static float in[NOTES * PHASES][NFFT_MAX];
+    static float spectra[FFT_BATCH_LANES][NFFT_MAX + 2];
+    static const int sizes[] = {256, 512, 1024, 2048};
+    int n = NOTES * PHASES / FFT_BATCH_LANES * FFT_BATCH_LANES;
+    float *spectrum[FFT_BATCH_LANES] = {spectra[0], spectra[1], spectra[2], spectra[3]};
+
+    printf("\nFour transforms per call on the SSE build against four float calls, %d frames per size\n\n", n);
+    printf("%6s %12s %12s %9s %12s\n", "nfft", "scalar us", "x4 us", "speedup", "max error");
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        int nfft = sizes[s];
+        kiss_fftr_cfg cfg = kiss_fftr_alloc(nfft, 0, NULL, NULL);
+        fft_x4_cfg cfg4 = fft_x4_alloc(nfft);
+
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < nfft; j++)
+                in[i][j] = signals[i][j] - 128.0f;
+
+        double start = bench_seconds();
+        for (int r = 0; r < REPEATS; r++)
+            for (int i = 0; i < n; i++)
+                kiss_fftr(cfg, in[i], (kiss_fft_cpx *)spectra[i % FFT_BATCH_LANES]);
+        double scalar_seconds = bench_seconds() - start;
+
+        start = bench_seconds();
+        for (int r = 0; r < REPEATS; r++)
+            for (int i = 0; i < n; i += FFT_BATCH_LANES)
+            {
+                const float *lanes[FFT_BATCH_LANES] = {in[i], in[i + 1], in[i + 2], in[i + 3]};
+                fft_x4_real(cfg4, lanes, spectrum);
+            }
+        double x4_seconds = bench_seconds() - start;
+
+        // Lanes against the scalar build on the last batch
+        float max_error = 0;
+        static kiss_fft_cpx ref[NFFT_MAX / 2 + 1];
+        for (int lane = 0; lane < FFT_BATCH_LANES; lane++)
+        {
+            kiss_fftr(cfg, in[n - FFT_BATCH_LANES + lane], ref);
+            for (int k = 0; k <= nfft / 2; k++)
+            {
+                max_error = fmaxf(max_error, fabsf(spectra[lane][2 * k] - ref[k].r));
+                max_error = fmaxf(max_error, fabsf(spectra[lane][2 * k + 1] - ref[k].i));
+            }
+        }
+
+        printf("%6d %12.2f %12.2f %8.2fx %12.3g\n", nfft, scalar_seconds * 1e6 / (REPEATS * n),
+               x4_seconds * 1e6 / (REPEATS * n), scalar_seconds / x4_seconds, max_error);
+        kiss_fftr_free(cfg);
+        fft_x4_free(cfg4);
+    }
+}
+#endif
+
+int main(void)
+{
+    srand(1);
+    for (int note = 0; note < NOTES; note++)
+    {
+        double freq = BENCH_FREQ_0V * pow(2, (NOTE_FIRST + note) / 12.0);
+        for (int p = 0; p < PHASES; p++)
+            bench_sawtooth_u8(signals[note * PHASES + p], NFFT_MAX, freq, p / (double)PHASES, 40, 2);
+    }
+
+    fixed_point_bench();
+    static_plan_bench();
+    fused_bench();
+#if FFT_BENCH_SIMD
+    simd_bench();
+#endif
+    return 0;
+}
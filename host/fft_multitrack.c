@@ -0,0 +1,139 @@
+// Offline pitch track of a multitrack recording, four FFTs per call on the SIMD
+// kiss_fftr build. Jobs are (frame, channel) pairs taken in order, so the lanes
+// hold four channels of one frame or, for fewer channels, consecutive frames.
+//
+//   fft_multitrack [--scalar] <raw f32 file> <channels> <sample rate> [nfft] [hop]
+//
+// The input is headerless interleaved 32 bit float, e.g. from
+//   sox in.wav -t f32 out.raw   or   ffmpeg -i in.wav -f f32le out.raw
+// Prints time,channel,pitch,level as CSV, time taken goes to stderr. --scalar
+// does the same with one float kiss_fftr call per job for comparison.
+
+#include <stdio.h>
+#include <string.h>
+#include "bench_common.h"
+#include "kiss_fftr.h"
+#include "fft_batch.h"
+#include "pitch.h"
+
+typedef struct
+{
+    long frame;
+    int channel;
+} job_t;
+
+static float *load(const char *path, long *count)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long bytes = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    float *data = malloc(bytes);
+    *count = data ? (long)fread(data, sizeof(float), bytes / sizeof(float), f) : 0;
+    fclose(f);
+    return data;
+}
+
+int main(int argc, char **argv)
+{
+    int scalar = argc > 1 && strcmp(argv[1], "--scalar") == 0;
+    argv += scalar;
+    argc -= scalar;
+    if (argc < 4)
+    {
+        fprintf(stderr, "usage: fft_multitrack [--scalar] <raw f32 file> <channels> <sample rate> [nfft] [hop]\n");
+        return 1;
+    }
+
+    int channels = atoi(argv[2]);
+    float fsamp = atof(argv[3]);
+    int nfft = argc > 4 ? atoi(argv[4]) : 4096;
+    int hop = argc > 5 ? atoi(argv[5]) : nfft / 4;
+    if (channels < 1 || fsamp <= 0 || nfft < 4 || nfft % 2 || hop < 1)
+    {
+        fprintf(stderr, "bad channels, sample rate, nfft or hop\n");
+        return 1;
+    }
+
+    long count;
+    float *data = load(argv[1], &count);
+    if (!data)
+    {
+        fprintf(stderr, "can't read %s\n", argv[1]);
+        return 1;
+    }
+    long samples = count / channels;
+    long frames = samples < nfft ? 0 : (samples - nfft) / hop + 1;
+
+    kiss_fftr_cfg cfg = kiss_fftr_alloc(nfft, 0, NULL, NULL);
+    fft_x4_cfg cfg4 = fft_x4_alloc(nfft);
+    float *in[FFT_BATCH_LANES], *spectrum[FFT_BATCH_LANES];
+    float level[FFT_BATCH_LANES];
+    float *power = malloc(sizeof(float) * (nfft / 2 + 1));
+    job_t jobs[FFT_BATCH_LANES];
+    for (int lane = 0; lane < FFT_BATCH_LANES; lane++)
+    {
+        in[lane] = malloc(sizeof(float) * nfft);
+        spectrum[lane] = malloc(sizeof(kiss_fft_cpx) * (nfft / 2 + 1));
+    }
+
+    printf("time,channel,pitch,level\n");
+    double start = bench_seconds();
+    long total = frames * channels;
+    for (long next = 0; next < total;)
+    {
+        // Gather up to four jobs, unused lanes repeat the last one
+        int used = 0;
+        for (; used < FFT_BATCH_LANES && next < total; used++, next++)
+        {
+            job_t *job = &jobs[used];
+            job->frame = next / channels;
+            job->channel = next % channels;
+
+            const float *src = data + job->frame * hop * channels + job->channel;
+            double sum = 0, sum_sq = 0;
+            for (int i = 0; i < nfft; i++)
+                sum += src[i * channels];
+            float avg = sum / nfft;
+            for (int i = 0; i < nfft; i++)
+            {
+                in[used][i] = src[i * channels] - avg;
+                sum_sq += in[used][i] * in[used][i];
+            }
+            level[used] = 10 * log10(sum_sq / nfft + 1e-20);
+        }
+        for (int lane = used; lane < FFT_BATCH_LANES; lane++)
+            memcpy(in[lane], in[used - 1], sizeof(float) * nfft);
+
+        if (scalar)
+        {
+            for (int lane = 0; lane < used; lane++)
+                kiss_fftr(cfg, in[lane], (kiss_fft_cpx *)spectrum[lane]);
+        }
+        else
+            fft_x4_real(cfg4, (const float *const *)in, spectrum);
+
+        for (int lane = 0; lane < used; lane++)
+        {
+            float pitch = pitch_fft_estimate((kiss_fft_cpx *)spectrum[lane], nfft, fsamp, power);
+            printf("%0.4f,%d,%0.2f,%0.1f\n", (jobs[lane].frame * hop + nfft / 2) / fsamp, jobs[lane].channel, pitch, level[lane]);
+        }
+    }
+    double elapsed = bench_seconds() - start;
+    fprintf(stderr, "%ld frames x %d channels of %d points in %0.3fs, %s\n", frames, channels, nfft, elapsed,
+            scalar ? "scalar" : "4 lanes per call");
+
+    for (int lane = 0; lane < FFT_BATCH_LANES; lane++)
+    {
+        free(in[lane]);
+        free(spectrum[lane]);
+    }
+    free(power);
+    free(data);
+    fft_x4_free(cfg4);
+    kiss_fftr_free(cfg);
+    return 0;
+}
@@ -0,0 +1,176 @@
+// C API of the quantizer and pitch code for host/python/picoquantizer.py. Every
+// function works on whole arrays so a sweep costs one call from Python, and
+// the per element work is the firmware's own code from quantizer/ and blink/.
+
+#include <math.h>
+#include <stdlib.h>
+#include "quantize.h"
+#include "kiss_fftr.h"
+#include "fft_kernels.h"
+#include "pitch.h"
+#include "yin.h"
+
+#define PQ_EXPORT extern "C" __attribute__((visibility("default")))
+
+static float VOLTAGES[NUM_PIANO_KEYS];
+static bool voltages_ready;
+
+static const float *voltages()
+{
+    if (!voltages_ready)
+    {
+        generateVoltages(VOLTAGES);
+        voltages_ready = true;
+    }
+    return VOLTAGES;
+}
+
+PQ_EXPORT int pq_num_keys(void)
+{
+    return NUM_PIANO_KEYS;
+}
+
+PQ_EXPORT void pq_frequencies(float *out)
+{
+    generateFrequencies(out);
+}
+
+PQ_EXPORT void pq_voltages(float *out)
+{
+    generateVoltages(out);
+}
+
+// Note index the quantizer outputs for each input voltage, -1 where it keeps the
+// previous note. scales holds one mask per input, or a single mask when scale_stride is 0
+PQ_EXPORT void pq_quantize(const float *volts, size_t n, const uint16_t *scales, size_t scale_stride, int32_t *out)
+{
+    if (n == 0)
+        return;
+    const float *table = voltages();
+    // Through a snap table as the firmware does, rebuilt whenever the scale changes
+    snap_table_t snap;
+    snap_table_build(&snap, scales[0]);
+    for (size_t i = 0; i < n; i++)
+    {
+        uint16_t scale = scales[i * scale_stride];
+        if (scale != snap.scale)
+            snap_table_build(&snap, scale);
+        out[i] = snap_note(&snap, quantizeValue(volts[i], table));
+    }
+}
+
+// Note index and DAC code for each input voltage under a table from
+// tools/scala_table.py, -1 and 0 where the previous note is kept. The lookup has
+// volts_per_step resolution, as on the firmware's ADC. Returns tuning_load()'s error
+PQ_EXPORT int pq_quantize_tuning(const uint8_t *table, size_t len, uint16_t scale, float volts_per_step,
+                                 const float *volts, size_t n, int32_t *out, uint16_t *codes)
+{
+    if (len < TUNING_HEADER_SIZE)
+        return -1;
+    tuning_t *tuning = (tuning_t *)malloc(sizeof(tuning_t));
+    if (!tuning)
+        return -1;
+    // The table's own DAC range, there is no firmware one to check against
+    int err = tuning_load(tuning, table, len, table[8] | (table[9] << 8), table[10] | (table[11] << 8));
+    if (!err)
+    {
+        tuning_apply_scale(tuning, scale, volts_per_step);
+        for (size_t i = 0; i < n; i++)
+        {
+            // The firmware's steps are whole, keep one that lands a hair under from rounding down
+            out[i] = tuning_quantize(tuning, volts[i] / volts_per_step + 1e-3f);
+            codes[i] = out[i] < 0 ? 0 : tuning->notes[out[i]].dac_code;
+        }
+    }
+    free(tuning);
+    return err;
+}
+
+// count bursts of n samples each, back to back
+PQ_EXPORT void pq_estimate_burst(const uint8_t *bursts, size_t count, size_t n, float *out)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = estimate_burst(bursts + i * n, n);
+    }
+}
+
+// count frames of nfft samples each through the blink FFT engine, Hann windowed
+// with the fused kernels when window is set, else the mean removed
+PQ_EXPORT int pq_pitch_fft(const uint8_t *frames, size_t count, int nfft, float fsamp, int window, float *out)
+{
+    kiss_fftr_cfg cfg = kiss_fftr_alloc(nfft, 0, NULL, NULL);
+    kiss_fft_scalar *in = (kiss_fft_scalar *)malloc(sizeof(kiss_fft_scalar) * nfft);
+    kiss_fft_cpx *spectrum = (kiss_fft_cpx *)malloc(sizeof(kiss_fft_cpx) * (nfft / 2 + 1));
+    float *power = (float *)malloc(sizeof(float) * (nfft / 2 + 1));
+    float *hann = (float *)malloc(sizeof(float) * nfft);
+    if (!cfg || !in || !spectrum || !power || !hann)
+    {
+        free(cfg);
+        free(in);
+        free(spectrum);
+        free(power);
+        free(hann);
+        return -1;
+    }
+
+    // Same table and bins as tools/gen_fft_plan.py --window hann
+    double bins[3] = {0, 0, 0};
+    for (int i = 0; i < nfft; i++)
+    {
+        double w = 0.5 - 0.5 * cos(2 * M_PI * i / nfft);
+        hann[i] = (float)w;
+        bins[0] += w;
+        bins[1] += w * cos(2 * M_PI * i / nfft);
+        bins[2] -= w * sin(2 * M_PI * i / nfft);
+    }
+    const kiss_fft_cpx window_bins[2] = {{(float)bins[0], 0}, {(float)bins[1], (float)bins[2]}};
+
+    pitch_set_interp(window ? PITCH_INTERP_PARABOLIC : PITCH_INTERP);
+    for (size_t f = 0; f < count; f++)
+    {
+        const uint8_t *capture = frames + f * nfft;
+        if (window)
+        {
+            float offset = fft_window_u8(capture, hann, nfft, in);
+            kiss_fftr(cfg, in, spectrum);
+            fft_window_dc(spectrum, offset, window_bins);
+        }
+        else
+        {
+            uint64_t sum = 0;
+            for (int i = 0; i < nfft; i++)
+                sum += capture[i];
+            float avg = (float)sum / nfft;
+            for (int i = 0; i < nfft; i++)
+                in[i] = (float)capture[i] - avg;
+            kiss_fftr(cfg, in, spectrum);
+        }
+        out[f] = pitch_fft_estimate(spectrum, nfft, fsamp, power);
+    }
+    pitch_set_interp(PITCH_INTERP);
+
+    free(cfg);
+    free(in);
+    free(spectrum);
+    free(power);
+    free(hann);
+    return 0;
+}
+
+// Integer YIN on the first YIN_NSAMP samples of each frame of stride samples
+PQ_EXPORT int pq_pitch_yin(const uint8_t *frames, size_t count, size_t stride, float *out)
+{
+    if (stride < YIN_NSAMP)
+        return -1;
+    for (size_t f = 0; f < count; f++)
+    {
+        out[f] = yin_estimate_u8(frames + f * stride) / 65536.0f;
+    }
+    return 0;
+}
+
+PQ_EXPORT int pq_yin_nsamp(void)
+{
+    return YIN_NSAMP;
+}
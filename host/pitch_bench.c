@@ -0,0 +1,301 @@
+// Host benchmark of the blink pitch engines: accuracy, analysis window and
+// cost per estimate on synthetic sawtooth input shaped like the 8 bit capture.
+//
+//   cmake -S host -B host/build && cmake --build host/build && host/build/pitch_bench
+
+#include <stdio.h>
+#include <string.h>
+#include "bench_common.h"
+#include "kiss_fftr.h"
+#include "pitch.h"
+#include "yin.h"
+#include "goertzel.h"
+#include "fft_kernels.h"
+#include "fft_fixed.h"
+#include "fft_plan_512.h"
+
+#define FFT_MAX 2048
+#define NOTE_FIRST 7 // E1, 41.2Hz
+#define NOTE_LAST 63 // C6, 1046.5Hz
+#define PHASES 4
+#define NOISE 2
+#define REPEATS 5
+#define STFT_SECONDS 10
+#define HOP 256 // blink.c HOP_SIZE, the new samples behind each streamed estimate
+
+static kiss_fftr_cfg fft_cfg_512;
+static kiss_fftr_cfg fft_cfg_2048;
+static kiss_fft_scalar fft_in[FFT_MAX];
+static kiss_fft_cpx fft_out[FFT_MAX / 2 + 1];
+static float fft_power[FFT_MAX / 2 + 1];
+static fft_s16_cfg fft_cfg_s16;
+static fft_s32_cfg fft_cfg_s32;
+static uint32_t fft_power_q[512 / 2 + 1];
+static float yin_in[YIN_NSAMP];
+static float frequencies[GOERTZEL_MAX_NOTES]; // The blink FREQUENCIES table
+static goertzel_bank_t goertzel_bank;
+
+// Same steps as the blink main loop: remove DC, real FFT, pick the pitch
+static float fft_estimate(const uint8_t *capture, int n, kiss_fftr_cfg cfg, int argmax_only)
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += capture[i];
+    float avg = (float)sum / n;
+    for (int i = 0; i < n; i++)
+        fft_in[i] = capture[i] - avg;
+
+    kiss_fftr(cfg, fft_in, fft_out);
+
+    if (!argmax_only)
+        return pitch_fft_estimate(fft_out, n, BENCH_FSAMP, fft_power);
+
+    // The original tracker: strongest bin
+    float max_power = 0;
+    int max_idx = 0;
+    for (int i = 0; i < n / 2; i++)
+    {
+        float power = fft_out[i].r * fft_out[i].r + fft_out[i].i * fft_out[i].i;
+        if (power > max_power)
+        {
+            max_power = power;
+            max_idx = i;
+        }
+    }
+    return max_idx * (float)BENCH_FSAMP / n;
+}
+
+static float engine_fft2048_argmax(const uint8_t *capture) { return fft_estimate(capture, 2048, fft_cfg_2048, 1); }
+static float engine_fft2048_hps(const uint8_t *capture) { return fft_estimate(capture, 2048, fft_cfg_2048, 0); }
+static float engine_fft512_hps(const uint8_t *capture) { return fft_estimate(capture, 512, fft_cfg_512, 0); }
+
+// Hann windowed with the fused kernels and the generated plan
+static float engine_fft512_hann(const uint8_t *capture)
+{
+    float offset = fft_window_u8(capture, fft_plan_512_window, 512, fft_in);
+    kiss_fftr(fft_plan_512, fft_in, fft_out);
+    fft_window_dc(fft_out, offset, fft_plan_512_window_bins);
+
+    pitch_set_interp(PITCH_INTERP_PARABOLIC);
+    float f = pitch_fft_estimate(fft_out, 512, BENCH_FSAMP, fft_power);
+    pitch_set_interp(PITCH_INTERP);
+    return f;
+}
+
+// The FPU-less path: fixed point transform, integer power and peak search
+static float engine_fft512_s16(const uint8_t *capture)
+{
+    int peaks[PITCH_PEAKS];
+    int npeaks = fft_s16_power_peaks(fft_cfg_s16, capture, pitch_fft_kmin(512, BENCH_FSAMP), fft_power_q, peaks, PITCH_PEAKS);
+    return pitch_fft_estimate_u32(fft_power_q, 512, BENCH_FSAMP, peaks, npeaks, fft_s16_bin, fft_cfg_s16);
+}
+
+static float engine_fft512_s32(const uint8_t *capture)
+{
+    int peaks[PITCH_PEAKS];
+    int npeaks = fft_s32_power_peaks(fft_cfg_s32, capture, pitch_fft_kmin(512, BENCH_FSAMP), fft_power_q, peaks, PITCH_PEAKS);
+    return pitch_fft_estimate_u32(fft_power_q, 512, BENCH_FSAMP, peaks, npeaks, fft_s32_bin, fft_cfg_s32);
+}
+
+static float engine_yin(const uint8_t *capture)
+{
+    for (int i = 0; i < YIN_NSAMP; i++)
+        yin_in[i] = capture[i];
+    return yin_estimate(yin_in);
+}
+
+static float engine_yin_u8(const uint8_t *capture)
+{
+    return yin_estimate_u8(capture) / 65536.0f;
+}
+
+// Every filter completes at least one block, then the strongest note is read out
+static float engine_goertzel(const uint8_t *capture)
+{
+    goertzel_reset(&goertzel_bank);
+    goertzel_update_u8(&goertzel_bank, capture, GOERTZEL_MAX_BLOCK);
+    int key = goertzel_detect(&goertzel_bank);
+    return key < 0 ? 0 : frequencies[key];
+}
+
+// The bank as blink.c runs it: each estimate only feeds the hop's new samples
+static float engine_goertzel_hop(const uint8_t *capture)
+{
+    goertzel_update_u8(&goertzel_bank, capture, HOP);
+    int key = goertzel_detect(&goertzel_bank);
+    return key < 0 ? 0 : frequencies[key];
+}
+
+typedef struct
+{
+    const char *name;
+    int nsamp; // Samples needed per estimate
+    float (*estimate)(const uint8_t *capture);
+    float (*cost)(const uint8_t *capture); // What is timed per estimate, estimate when NULL
+} engine_t;
+
+static const engine_t engines[] = {
+    {"fft2048 argmax", 2048, engine_fft2048_argmax},
+    {"fft2048 hps", 2048, engine_fft2048_hps},
+    {"fft512 hps", 512, engine_fft512_hps},
+    {"fft512 hann", 512, engine_fft512_hann},
+    {"fft512 s16 int", 512, engine_fft512_s16},
+    {"fft512 s32 int", 512, engine_fft512_s32},
+    {"yin float", YIN_NSAMP, engine_yin},
+    {"yin int", YIN_NSAMP, engine_yin_u8},
+    {"goertzel", GOERTZEL_MAX_BLOCK, engine_goertzel, engine_goertzel_hop},
+};
+
+// Per sample cost of the Goertzel bank and how soon each note can report,
+// which is its block length rather than a whole analysis window
+static void goertzel_bench(const uint8_t *capture)
+{
+    static const struct
+    {
+        const char *name;
+        uint16_t mask;
+    } scales[] = {{"chromatic", GOERTZEL_ALL_NOTES}, {"A major", 0xAB5}, {"A minor pentatonic", 0x4A9}};
+
+    printf("\nGoertzel bank per sample at %0.0fHz\n", BENCH_FSAMP);
+    printf("%-20s %8s %14s %14s %10s\n", "scale", "filters", "ns/sample", "cycles/sample", "load");
+    for (size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); s++)
+    {
+        goertzel_bank_t bank;
+        goertzel_init(&bank, frequencies, GOERTZEL_MAX_NOTES, BENCH_FSAMP, scales[s].mask);
+
+        double start = bench_seconds();
+        uint64_t start_cycles = bench_cycles();
+        for (int r = 0; r < REPEATS * 10; r++)
+            goertzel_update_u8(&bank, capture, FFT_MAX);
+        uint64_t cycles = bench_cycles() - start_cycles;
+        double elapsed = bench_seconds() - start;
+
+        double per_sample = elapsed / (REPEATS * 10 * FFT_MAX);
+        printf("%-20s %8d %14.1f %14.0f %9.3f%%\n", scales[s].name, bank.count, per_sample * 1e9,
+               BENCH_HAVE_CYCLES ? (double)cycles / (REPEATS * 10 * FFT_MAX) : 0, 100 * per_sample * BENCH_FSAMP);
+    }
+
+    printf("\nLatency per note (one block):");
+    for (int i = 0; i < goertzel_bank.count; i += 12)
+        printf(" %0.0fHz %0.1fms,", frequencies[goertzel_bank.key[i]], (goertzel_bank.filters[i].block << goertzel_bank.filters[i].stage) * 1000 / BENCH_FSAMP);
+    printf("\n");
+}
+
+// Streams STFT_SECONDS of a rising note sweep through the same mirrored history
+// as blink.c, one estimate per hop over the latest 512 samples
+static void stft_bench(const engine_t *engine)
+{
+    static const int hops[] = {512, 256, 128, 64};
+    const int nsamp = 512;
+    int total = (int)(STFT_SECONDS * BENCH_FSAMP);
+    uint8_t *stream = malloc(total);
+    uint8_t history[2 * 512];
+
+    for (int block = 0; block < total / nsamp; block++)
+    {
+        double freq = BENCH_FREQ_0V * pow(2, (NOTE_FIRST + block % (NOTE_LAST - NOTE_FIRST)) / 12.0);
+        bench_sawtooth_u8(stream + block * nsamp, nsamp, freq, 0, 40, NOISE);
+    }
+
+    printf("\nSTFT with %s over %d samples, %ds of input\n", engine->name, nsamp, STFT_SECONDS);
+    printf("%6s %14s %14s %10s\n", "hop", "realtime fps", "host fps", "load");
+    for (size_t h = 0; h < sizeof(hops) / sizeof(hops[0]); h++)
+    {
+        int hop = hops[h];
+        int pos = 0;
+        int frames = 0;
+        memset(history, 0, sizeof(history));
+
+        double start = bench_seconds();
+        for (int offset = 0; offset + hop <= total; offset += hop)
+        {
+            memcpy(history + pos, stream + offset, hop);
+            memcpy(history + pos + nsamp, stream + offset, hop);
+            pos = (pos + hop) % nsamp;
+            if (offset + hop < nsamp)
+                continue;
+
+            // The window ends with the newest sample, engines read from its start
+            engine->estimate(history + pos + nsamp - engine->nsamp);
+            frames++;
+        }
+        double elapsed = bench_seconds() - start;
+
+        double realtime_fps = BENCH_FSAMP / hop;
+        double host_fps = frames / elapsed;
+        printf("%6d %14.2f %14.0f %9.3f%%\n", hop, realtime_fps, host_fps, 100 * realtime_fps / host_fps);
+    }
+    free(stream);
+}
+
+int main(void)
+{
+    static uint8_t signals[NOTE_LAST - NOTE_FIRST + 1][PHASES][FFT_MAX];
+    double truth[NOTE_LAST - NOTE_FIRST + 1];
+
+    fft_cfg_512 = kiss_fftr_alloc(512, 0, 0, 0);
+    fft_cfg_2048 = kiss_fftr_alloc(2048, 0, 0, 0);
+    fft_cfg_s16 = fft_s16_alloc(512);
+    fft_cfg_s32 = fft_s32_alloc(512);
+    for (int k = 0; k < GOERTZEL_MAX_NOTES; k++)
+        frequencies[k] = BENCH_FREQ_0V * pow(2, k / 12.0);
+    goertzel_init(&goertzel_bank, frequencies, GOERTZEL_MAX_NOTES, BENCH_FSAMP, GOERTZEL_ALL_NOTES);
+
+    srand(1);
+    for (int note = NOTE_FIRST; note <= NOTE_LAST; note++)
+    {
+        truth[note - NOTE_FIRST] = BENCH_FREQ_0V * pow(2, note / 12.0);
+        for (int p = 0; p < PHASES; p++)
+            bench_sawtooth_u8(signals[note - NOTE_FIRST][p], FFT_MAX, truth[note - NOTE_FIRST], p / (double)PHASES, 40, NOISE);
+    }
+
+    int estimates = (NOTE_LAST - NOTE_FIRST + 1) * PHASES;
+    printf("%d estimates per engine, sawtooth %0.1f-%0.1fHz at %0.0fHz, +-%d counts noise\n\n",
+           estimates, truth[0], truth[NOTE_LAST - NOTE_FIRST], BENCH_FSAMP, NOISE);
+    printf("%-16s %9s %10s %11s %12s %14s\n", "engine", "window", "semitone", "mean err", "us/estimate", "cycles/estimate");
+
+    for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++)
+    {
+        const engine_t *engine = &engines[e];
+        int correct = 0;
+        double cents_total = 0;
+
+        for (int i = 0; i < NOTE_LAST - NOTE_FIRST + 1; i++)
+        {
+            for (int p = 0; p < PHASES; p++)
+            {
+                double cents = bench_cents(engine->estimate(signals[i][p]), truth[i]);
+                if (fabs(cents) < 50)
+                {
+                    correct++;
+                    cents_total += fabs(cents);
+                }
+            }
+        }
+
+        float (*cost)(const uint8_t *) = engine->cost ? engine->cost : engine->estimate;
+        double start = bench_seconds();
+        uint64_t start_cycles = bench_cycles();
+        for (int r = 0; r < REPEATS; r++)
+            for (int i = 0; i < NOTE_LAST - NOTE_FIRST + 1; i++)
+                for (int p = 0; p < PHASES; p++)
+                    cost(signals[i][p]);
+        uint64_t cycles = bench_cycles() - start_cycles;
+        double elapsed = bench_seconds() - start;
+
+        printf("%-16s %7.1fms %9.1f%% %9.1fc %12.2f %14.0f\n", engine->name,
+               engine->nsamp * 1000 / BENCH_FSAMP, 100.0 * correct / estimates,
+               correct ? cents_total / correct : 0, elapsed * 1e6 / (REPEATS * estimates),
+               BENCH_HAVE_CYCLES ? (double)cycles / (REPEATS * estimates) : 0);
+    }
+
+    stft_bench(&engines[2]);
+    stft_bench(&engines[7]);
+    goertzel_bench(signals[0][0]);
+
+    kiss_fftr_free(fft_cfg_512);
+    kiss_fftr_free(fft_cfg_2048);
+    fft_s16_free(fft_cfg_s16);
+    fft_s32_free(fft_cfg_s32);
+    return 0;
+}
@@ -0,0 +1,149 @@
+"""NumPy binding to the firmware's quantizer and pitch code (libpicoquantizer).
+
+Build the library first:
+
+    cmake -S host -B host/build && cmake --build host/build
+
+It is looked for in host/build, or at $PICOQUANTIZER_LIB.
+Arrays that already have the right dtype and are C contiguous are passed to
+the library as they are, anything else is converted once.
+
+    import numpy as np, picoquantizer as pq
+    volts = np.random.uniform(0, 6, 1_000_000).astype(np.float32)
+    notes = pq.quantize(volts, scale=0b101010110101)   # C major
+"""
+
+import ctypes
+import os
+
+import numpy as np
+
+_HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def _load():
+    candidates = [os.environ.get("PICOQUANTIZER_LIB")]
+    candidates.append(os.path.join(_HERE, "..", "build", "libpicoquantizer.so"))
+    candidates.append(os.path.join(_HERE, "..", "build", "libpicoquantizer.dylib"))
+    for path in candidates:
+        if path and os.path.exists(path):
+            return ctypes.CDLL(path)
+    raise OSError("libpicoquantizer not found, build host/ or set PICOQUANTIZER_LIB")
+
+
+_lib = _load()
+
+_f32p = np.ctypeslib.ndpointer(np.float32, flags="C_CONTIGUOUS")
+_i32p = np.ctypeslib.ndpointer(np.int32, flags="C_CONTIGUOUS")
+_u16p = np.ctypeslib.ndpointer(np.uint16, flags="C_CONTIGUOUS")
+_u8p = np.ctypeslib.ndpointer(np.uint8, flags="C_CONTIGUOUS")
+_size = ctypes.c_size_t
+
+_lib.pq_num_keys.restype = ctypes.c_int
+_lib.pq_frequencies.argtypes = [_f32p]
+_lib.pq_voltages.argtypes = [_f32p]
+_lib.pq_quantize.argtypes = [_f32p, _size, _u16p, _size, _i32p]
+_lib.pq_quantize_tuning.argtypes = [_u8p, _size, ctypes.c_uint16, ctypes.c_float, _f32p, _size, _i32p, _u16p]
+_lib.pq_quantize_tuning.restype = ctypes.c_int
+_lib.pq_estimate_burst.argtypes = [_u8p, _size, _size, _f32p]
+_lib.pq_pitch_fft.argtypes = [_u8p, _size, ctypes.c_int, ctypes.c_float, ctypes.c_int, _f32p]
+_lib.pq_pitch_fft.restype = ctypes.c_int
+_lib.pq_pitch_yin.argtypes = [_u8p, _size, _size, _f32p]
+_lib.pq_pitch_yin.restype = ctypes.c_int
+_lib.pq_yin_nsamp.restype = ctypes.c_int
+
+NUM_PIANO_KEYS = _lib.pq_num_keys()
+YIN_NSAMP = _lib.pq_yin_nsamp()
+ALL_NOTES = 0xFFF
+# Input resolution of the firmware's tuning lookup: half an 8 bit ADC count,
+# VOLT_MAX / 256 / INPUT_VOLTAGE_DIVISION / 2 in quantizer.cpp
+ADC_VOLTS_PER_STEP = 3.3 / 256 / 0.333 / 2
+
+
+def _c(array, dtype):
+    # No copy when it already fits
+    return np.ascontiguousarray(array, dtype=dtype)
+
+
+def frequencies():
+    """FREQUENCIES as the quantizer firmware builds it"""
+    out = np.empty(NUM_PIANO_KEYS, np.float32)
+    _lib.pq_frequencies(out)
+    return out
+
+
+def voltages():
+    """VOLTAGES as the quantizer firmware builds it"""
+    out = np.empty(NUM_PIANO_KEYS, np.float32)
+    _lib.pq_voltages(out)
+    return out
+
+
+def quantize(volts, scale=ALL_NOTES):
+    """Note index the quantizer outputs for each input voltage, -1 where it
+    keeps the previous note. scale is one 12 bit mask, or an array of masks
+    broadcast against volts for sweeps over scales."""
+    volts = np.asarray(volts)
+    scale = np.asarray(scale)
+    if scale.ndim == 0:
+        flat_scale = _c(scale.reshape(1), np.uint16)
+        stride = 0
+        shape = volts.shape
+    else:
+        volts, scale = np.broadcast_arrays(volts, scale)
+        flat_scale = _c(scale, np.uint16).reshape(-1)
+        stride = 1
+        shape = volts.shape
+    flat = _c(volts, np.float32).reshape(-1)
+    out = np.empty(flat.size, np.int32)
+    _lib.pq_quantize(flat, flat.size, flat_scale, stride, out)
+    return out.reshape(shape)
+
+
+def quantize_tuning(table, volts, scale=ALL_NOTES, volts_per_step=ADC_VOLTS_PER_STEP):
+    """Note index and DAC code for each input voltage under a tuning table
+    (bytes, or the path of a tools/scala_table.py --out file). The index is -1
+    and the code 0 where the quantizer keeps the previous note."""
+    if isinstance(table, (str, os.PathLike)):
+        with open(table, "rb") as f:
+            table = f.read()
+    table = np.frombuffer(bytes(table), np.uint8)
+    volts = np.asarray(volts)
+    flat = _c(volts, np.float32).reshape(-1)
+    notes = np.empty(flat.size, np.int32)
+    codes = np.empty(flat.size, np.uint16)
+    err = _lib.pq_quantize_tuning(table, table.size, scale, volts_per_step, flat, flat.size, notes, codes)
+    if err:
+        raise ValueError("tuning table is malformed" if err == -1 else "tuning table rejected")
+    return notes.reshape(volts.shape), codes.reshape(volts.shape)
+
+
+def estimate_burst(bursts):
+    """Burst filter on each row of a (count, n) uint8 array, in ADC counts"""
+    bursts = _c(bursts, np.uint8)
+    if bursts.ndim != 2:
+        raise ValueError("bursts must be (count, n)")
+    out = np.empty(bursts.shape[0], np.float32)
+    _lib.pq_estimate_burst(bursts, bursts.shape[0], bursts.shape[1], out)
+    return out
+
+
+def pitch_fft(frames, fsamp=8000.0, window=True):
+    """blink FFT engine on each row of a (count, nfft) uint8 array, in Hz"""
+    frames = _c(frames, np.uint8)
+    if frames.ndim != 2 or frames.shape[1] % 2:
+        raise ValueError("frames must be (count, nfft) with nfft even")
+    out = np.empty(frames.shape[0], np.float32)
+    if _lib.pq_pitch_fft(frames, frames.shape[0], frames.shape[1], fsamp, int(window), out):
+        raise MemoryError("pq_pitch_fft")
+    return out
+
+
+def pitch_yin(frames):
+    """Integer YIN on the first YIN_NSAMP samples of each row of a uint8 array, in Hz"""
+    frames = _c(frames, np.uint8)
+    if frames.ndim != 2 or frames.shape[1] < YIN_NSAMP:
+        raise ValueError("frames must be (count, >= YIN_NSAMP)")
+    out = np.empty(frames.shape[0], np.float32)
+    _lib.pq_pitch_yin(frames, frames.shape[0], frames.shape[1], out)
+    return out
@@ -0,0 +1,268 @@
+"""Decodes a gate recorder dump from the quantizer and runs every recorded
+burst back through the firmware's code, to find out why a note came out wrong.
+
+    python3 host/python/replay_recording.py dump.bin
+    python3 host/python/replay_recording.py --port /dev/ttyACM0 --save dump.bin
+    python3 host/python/replay_recording.py dump.bin --tuning 19edo.bin --list
+
+--port sends 'd' (RECORDER_DUMP_CHAR in quantizer.cpp) and reads the dump back.
+Each gate's burst is filtered with estimate_burst() and quantized to the scale
+recorded with it, and the DAC code that gives is compared with the one the
+quantizer wrote. A mismatch means the firmware and the host build disagree,
+a match with a wrong note means the input really was that voltage. Gates
+quantized through a tuning table are only checked against --tuning, which
+should be the table that was loaded at the time. See quantizer/recorder.h
+for the format.
+"""
+
+import argparse
+import os
+import select
+import struct
+import sys
+import termios
+import time
+import tty
+
+import numpy as np
+
+import picoquantizer as pq
+
+DUMP_MAGIC = b"PQRD"
+DUMP_HEADER = "<4sHHII"
+BLOCK_MAGIC = 0x42525150
+BLOCK_HEADER = "<IIIHHHHHH"
+VERSION = 1
+RECORD_CHANNEL = 0x01
+RECORD_SCALE = 0x02
+RECORD_HELD = 0x04
+RECORD_TUNING = 0x08
+RECORD_ESCAPE = 15
+DUMP_CHAR = b"d"
+TIMEOUT_S = 5
+
+# quantizer.cpp, in the precision the firmware works in
+INPUT_VOLTAGE_DIVISION = 0.333
+CONVERSION_FACTOR = np.float32(np.float32(3.3) / np.float32(256))
+ADC_VOLTS_PER_COUNT = np.float32(np.float64(CONVERSION_FACTOR) / INPUT_VOLTAGE_DIVISION)
+SPI_VMAX = np.float32(5.0)
+DAC_MAX_CODE = 1023
+
+
+def read_port(port):
+    """Asks the quantizer for a dump and returns its bytes"""
+    fd = os.open(port, os.O_RDWR | os.O_NOCTTY)
+    try:
+        tty.setraw(fd)
+        termios.tcflush(fd, termios.TCIFLUSH)
+        os.write(fd, DUMP_CHAR)
+
+        data = b""
+        size = None
+        deadline = time.monotonic() + TIMEOUT_S
+        while time.monotonic() < deadline:
+            if select.select([fd], [], [], 0.1)[0]:
+                data += os.read(fd, 65536)
+                deadline = time.monotonic() + TIMEOUT_S
+            if size is None:
+                # Text printed before the dump is skipped
+                start = data.find(DUMP_MAGIC)
+                if start < 0 or len(data) - start < struct.calcsize(DUMP_HEADER):
+                    continue
+                data = data[start:]
+                _, _, block_size, count, _ = struct.unpack_from(DUMP_HEADER, data)
+                size = struct.calcsize(DUMP_HEADER) + block_size * count
+            if size is not None and len(data) >= size:
+                return data[:size]
+        raise SystemExit("no dump from the quantizer")
+    finally:
+        os.close(fd)
+
+
+class Reader:
+    def __init__(self, data, pos, end):
+        self.data = data
+        self.pos = pos
+        self.end = end
+
+    def byte(self):
+        if self.pos >= self.end:
+            raise ValueError("record runs off the end of its block")
+        value = self.data[self.pos]
+        self.pos += 1
+        return value
+
+    def varint(self):
+        value = 0
+        shift = 0
+        while True:
+            b = self.byte()
+            value |= (b & 0x7F) << shift
+            shift += 7
+            if b < 0x80:
+                return value
+
+    def nibbles(self, count):
+        """count nibbles, high first, from whole bytes"""
+        out = []
+        while len(out) < count:
+            b = self.byte()
+            out.append(b >> 4)
+            out.append(b & 0x0F)
+        return out
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def decode_burst(reader, n):
+    if n == 0:
+        return []
+    burst = [reader.byte()]
+    # Escapes take two more nibbles, which may run into the next byte
+    pending = []
+    while len(burst) < n:
+        if not pending:
+            pending = reader.nibbles(1)
+        z = pending.pop(0)
+        if z == RECORD_ESCAPE:
+            while len(pending) < 2:
+                pending += reader.nibbles(1)
+            burst.append(pending.pop(0) << 4 | pending.pop(0))
+        else:
+            burst.append((burst[-1] + unzigzag(z)) & 0xFF)
+    return burst
+
+
+def decode_block(block):
+    magic, seq, start_us, used, scale, code_a, code_b, version, _ = struct.unpack_from(BLOCK_HEADER, block)
+    if magic != BLOCK_MAGIC:
+        raise ValueError("bad block magic")
+    if version != VERSION:
+        raise ValueError(f"block version {version}, expected {VERSION}")
+    header = struct.calcsize(BLOCK_HEADER)
+    reader = Reader(block, header, header + used)
+    codes = [code_a, code_b]
+    now = start_us
+    records = []
+    while reader.pos < reader.end:
+        tag = reader.byte()
+        now = (now + reader.varint()) & 0xFFFFFFFF
+        if tag & RECORD_SCALE:
+            scale = reader.byte() | reader.byte() << 8
+        n = reader.byte()
+        burst = decode_burst(reader, n)
+        channel = tag & RECORD_CHANNEL
+        code = None
+        if not tag & RECORD_HELD:
+            codes[channel] = (codes[channel] + unzigzag(reader.varint())) & 0xFFFF
+            code = codes[channel]
+        records.append({
+            "seq": seq, "time_us": now, "channel": channel, "scale": scale,
+            "tuning": bool(tag & RECORD_TUNING), "burst": burst, "code": code,
+        })
+    return records
+
+
+def decode_dump(data):
+    magic, version, block_size, count, lost = struct.unpack_from(DUMP_HEADER, data)
+    if magic != DUMP_MAGIC:
+        raise SystemExit("not a recorder dump")
+    if version != VERSION:
+        raise SystemExit(f"dump version {version}, expected {VERSION}")
+    offset = struct.calcsize(DUMP_HEADER)
+    if len(data) < offset + block_size * count:
+        raise SystemExit(f"dump cut short, {count} blocks announced")
+
+    records = []
+    for i in range(count):
+        block = data[offset + i * block_size:offset + (i + 1) * block_size]
+        try:
+            records += decode_block(block)
+        except ValueError as e:
+            print(f"block {i}: {e}, skipped", file=sys.stderr)
+    return records, count, lost
+
+
+def dac_code(volts):
+    """DAC_code() in quantizer.cpp"""
+    volts = np.minimum(volts.astype(np.float32), SPI_VMAX)
+    volt_per_bit = np.float32(SPI_VMAX / np.float64(DAC_MAX_CODE))
+    return np.floor(volts / volt_per_bit).astype(np.int32)
+
+
+def replay(records, tuning):
+    """Expected DAC code of each record, -1 where the output holds, None where
+    it can't be checked"""
+    expected = [None] * len(records)
+    by_length = {}
+    for i, record in enumerate(records):
+        if record["burst"]:
+            by_length.setdefault(len(record["burst"]), []).append(i)
+
+    for indices in by_length.values():
+        avg = pq.estimate_burst(np.array([records[i]["burst"] for i in indices], np.uint8))
+        adc_voltage = avg.astype(np.float32) * ADC_VOLTS_PER_COUNT
+        for i, avg_i, volts in zip(indices, avg, adc_voltage):
+            record = records[i]
+            if record["tuning"]:
+                if tuning is None:
+                    continue
+                # tuning_quantize(avg * 2), as a voltage for quantize_tuning()
+                step_volts = np.float32(avg_i * 2 * pq.ADC_VOLTS_PER_STEP)
+                note, code = pq.quantize_tuning(tuning, [step_volts], scale=record["scale"])
+                expected[i] = -1 if note[0] < 0 else int(code[0])
+            else:
+                note = pq.quantize([volts], scale=record["scale"])[0]
+                expected[i] = -1 if note < 0 else int(dac_code(pq.voltages()[note:note + 1])[0])
+    return expected
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("dump", nargs="?", help="dump saved from the quantizer")
+    parser.add_argument("--port", help="USB serial device of the quantizer, to dump from")
+    parser.add_argument("--save", help="file to keep the dump from --port in")
+    parser.add_argument("--tuning", help="tools/scala_table.py table to check tuning gates against")
+    parser.add_argument("--list", action="store_true", help="print every gate, not only the mismatches")
+    args = parser.parse_args()
+    if not args.dump and not args.port:
+        parser.error("a dump or --port is needed")
+
+    if args.port:
+        data = read_port(args.port)
+        if args.save:
+            with open(args.save, "wb") as f:
+                f.write(data)
+    else:
+        with open(args.dump, "rb") as f:
+            data = f.read()
+    tuning = None
+    if args.tuning:
+        with open(args.tuning, "rb") as f:
+            tuning = f.read()
+
+    records, blocks, lost = decode_dump(data)
+    expected = replay(records, tuning)
+
+    checked = mismatches = 0
+    for record, want in zip(records, expected):
+        got = -1 if record["code"] is None else record["code"]
+        bad = want is not None and want != got
+        checked += want is not None
+        mismatches += bad
+        if bad or args.list:
+            burst = record["burst"]
+            print(f"{record['time_us']:10d}us {'AB'[record['channel']]} scale {record['scale']:03x}"
+                  f"{' tuning' if record['tuning'] else ''} n {len(burst):3d}"
+                  f" mean {np.mean(burst) if burst else 0:6.2f} code {got:5d}"
+                  f" expected {'-' if want is None else want:>5}{'  MISMATCH' if bad else ''}")
+
+    print(f"{len(records)} gates in {blocks} blocks, {lost} blocks lost, "
+          f"{checked} checked, {mismatches} mismatched")
+    return 1 if mismatches else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,33 @@
+"""Every scale mask against a sweep of input voltages, at native speed.
+
+    python3 host/python/sweep_scales.py [inputs per scale]
+
+For each of the 4095 non-empty masks, how often the quantizer holds the
+previous note (no enabled note in reach) and the largest jump it makes.
+"""
+
+import sys
+import time
+
+import numpy as np
+
+import picoquantizer as pq
+
+n = int(sys.argv[1]) if len(sys.argv) > 1 else 1000
+volts = np.linspace(0, pq.voltages()[-1], n, dtype=np.float32)
+scales = np.arange(1, 4096, dtype=np.uint16)
+
+start = time.perf_counter()
+notes = pq.quantize(volts[None, :], scales[:, None])
+elapsed = time.perf_counter() - start
+
+table = pq.voltages()
+held = (notes < 0).mean(axis=1)
+out_volts = np.where(notes >= 0, table[np.clip(notes, 0, None)], np.nan)
+error = np.nanmax(np.abs(out_volts - volts[None, :]), axis=1)
+
+print(f"{notes.size} quantizations in {elapsed * 1e3:0.1f}ms ({notes.size / elapsed / 1e6:0.1f}M/s)")
+for name, mask in (("chromatic", 0xFFF), ("C major", 0xAB5), ("C minor pentatonic", 0x4A9), ("C only", 0x001)):
+    i = mask - 1
+    print(f"{name:20s} held {held[i] * 100:5.1f}%  max distance {error[i]:0.3f}V")
+print(f"worst held fraction {held.max() * 100:0.1f}% for mask {scales[held.argmax()]:#05x}")
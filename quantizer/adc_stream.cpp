@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include "adc_stream.h"
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "tusb.h"
+#include "device/usbd_pvt.h"
+
+#if ADC_STREAM_BUFFERS & (ADC_STREAM_BUFFERS - 1)
+#error "ADC_STREAM_BUFFERS must be a power of 2"
+#endif
+
+#define STREAM_PAYLOAD (ADC_STREAM_BUFFER_SIZE - sizeof(adc_stream_header_t))
+#define STREAM_DMA_IRQ 1 // DMA_IRQ_1, the gate captures poll their channel
+
+// Who has each buffer. The DMA IRQ moves them from DMA to FULL, the USB task
+// from FULL to USB and back to FREE
+enum
+{
+    BUF_FREE,
+    BUF_DMA,
+    BUF_FULL,
+    BUF_USB,
+};
+
+static uint8_t __attribute__((aligned(4))) stream_bufs[ADC_STREAM_BUFFERS][ADC_STREAM_BUFFER_SIZE];
+// Where the DMA goes instead of a buffer that is still taken, thrown away
+static uint8_t __attribute__((aligned(4))) spill_buf[STREAM_PAYLOAD];
+static volatile uint8_t buf_state[ADC_STREAM_BUFFERS];
+
+// Where the data channel writes each pass, the control channel reads them in
+// turn around the ring. Pass i goes to buffer i % ADC_STREAM_BUFFERS or to
+// spill_buf. Aligned to its size for the DMA's address wrap
+static uint8_t *volatile stream_addrs[ADC_STREAM_BUFFERS]
+    __attribute__((aligned(ADC_STREAM_BUFFERS * sizeof(uint8_t *))));
+
+// Full buffers in the order they were filled, the DMA IRQ pushes, the USB task pops
+static uint8_t full_ring[ADC_STREAM_BUFFERS];
+static uint32_t full_head;
+static uint32_t full_tail;
+
+// The data channel fills a pass, then chains to the control channel, which
+// writes the next address from stream_addrs and retriggers it. Neither waits
+// for the IRQ, which only has to keep up with the ring, not with one pass
+static int data_chan = -1;
+static int ctrl_chan = -1;
+static uint32_t dma_pos; // Ring position the data channel was filling at the last IRQ
+static uint32_t stream_seq;
+static uint32_t stream_dropped;
+static uint8_t stream_channels;
+static uint32_t saved_div; // The gates' ADC clock divider
+static volatile bool active;
+
+// Written by the USB task: -1 nothing asked, 0 stop, else the channels to start
+static int stream_request = -1;
+
+// USB task only
+static uint8_t stream_rhport;
+static uint8_t stream_ep; // 0 until the host configures the interface
+static int in_flight = -1;
+
+static uint8_t *payload_of(int buf)
+{
+    return stream_bufs[buf] + sizeof(adc_stream_header_t);
+}
+
+// Points ring position pos back at its buffer if the USB task is done with it
+static void arm_position(uint32_t pos)
+{
+    if (buf_state[pos] == BUF_FREE)
+    {
+        buf_state[pos] = BUF_DMA;
+        stream_addrs[pos] = payload_of(pos);
+    }
+    else if (buf_state[pos] != BUF_DMA)
+    {
+        stream_addrs[pos] = spill_buf;
+    }
+}
+
+// Sends the oldest full buffer if the endpoint is idle. USB task
+static void stream_kick(void *param)
+{
+    (void)param;
+    if (stream_ep == 0 || in_flight >= 0)
+        return;
+    uint32_t tail = full_tail;
+    if (__atomic_load_n(&full_head, __ATOMIC_ACQUIRE) == tail)
+        return;
+    int buf = full_ring[tail % ADC_STREAM_BUFFERS];
+    __atomic_store_n(&full_tail, tail + 1, __ATOMIC_RELEASE);
+
+    // Straight from where the DMA left it
+    buf_state[buf] = BUF_USB;
+    if (!usbd_edpt_xfer(stream_rhport, stream_ep, stream_bufs[buf], ADC_STREAM_BUFFER_SIZE))
+    {
+        buf_state[buf] = BUF_FREE;
+        return;
+    }
+    in_flight = buf;
+}
+
+// One or more passes are done. Each is queued for USB, or counted as dropped
+// if it went to spill_buf, and the positions behind the DMA are pointed back
+// at their buffers
+static void stream_dma_irq(void)
+{
+    if (!dma_irqn_get_channel_status(STREAM_DMA_IRQ, data_chan))
+        return;
+    dma_irqn_acknowledge_channel(STREAM_DMA_IRQ, data_chan);
+
+    // The control channel has read the position being filled, and points at the
+    // one it reads next. Late by a pass or more, several are done at once
+    const uint32_t mask = ADC_STREAM_BUFFERS - 1;
+    uint32_t next = (dma_channel_hw_addr(ctrl_chan)->read_addr - (uintptr_t)stream_addrs) / sizeof(uint8_t *);
+    uint32_t filling = (next - 1) & mask;
+    while (dma_pos != filling)
+    {
+        uint32_t done = dma_pos;
+        if (stream_addrs[done] != spill_buf)
+        {
+            adc_stream_header_t *header = (adc_stream_header_t *)stream_bufs[done];
+            header->magic = ADC_STREAM_MAGIC;
+            header->seq = stream_seq;
+            header->sample_rate = ADC_STREAM_SAMPLE_RATE;
+            header->channels = stream_channels;
+            header->bits = 8;
+            header->dropped = MIN(stream_dropped, UINT16_MAX);
+            stream_dropped = 0;
+
+            buf_state[done] = BUF_FULL;
+            full_ring[full_head % ADC_STREAM_BUFFERS] = done;
+            __atomic_store_n(&full_head, full_head + 1, __ATOMIC_RELEASE);
+        }
+        else
+        {
+            stream_dropped++;
+        }
+        stream_seq++;
+        dma_pos = (done + 1) & mask;
+    }
+
+    // Except the one being filled and the one the control channel reads next,
+    // whose addresses are what those passes will be judged by above
+    for (uint32_t pos = (next + 1) & mask; pos != filling; pos = (pos + 1) & mask)
+        arm_position(pos);
+    usbd_defer_func(stream_kick, NULL, true);
+}
+
+static bool stream_start(uint8_t channels)
+{
+    if (data_chan < 0)
+    {
+        data_chan = dma_claim_unused_channel(false);
+        ctrl_chan = dma_claim_unused_channel(false);
+        if (data_chan < 0 || ctrl_chan < 0)
+        {
+            if (data_chan >= 0)
+                dma_channel_unclaim(data_chan);
+            if (ctrl_chan >= 0)
+                dma_channel_unclaim(ctrl_chan);
+            data_chan = ctrl_chan = -1;
+            return false;
+        }
+        irq_add_shared_handler(DMA_IRQ_0 + STREAM_DMA_IRQ, stream_dma_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_0 + STREAM_DMA_IRQ, true);
+    }
+
+    adc_run(false);
+    adc_fifo_drain();
+    saved_div = adc_hw->div;
+
+    // Buffers still queued or on the bus from the last stream are dropped, the
+    // one the USB task is sending finishes first
+    uint32_t irq = save_and_disable_interrupts();
+    full_tail = full_head;
+    for (int i = 0; i < ADC_STREAM_BUFFERS; i++)
+    {
+        if (buf_state[i] != BUF_USB)
+            buf_state[i] = BUF_FREE;
+    }
+    restore_interrupts(irq);
+
+    stream_seq = 0;
+    stream_dropped = 0;
+    stream_channels = channels;
+    for (uint32_t pos = 0; pos < ADC_STREAM_BUFFERS; pos++)
+        arm_position(pos);
+    dma_pos = 0;
+
+    // A pass of samples, then the control channel
+    dma_channel_config data_cfg = dma_channel_get_default_config(data_chan);
+    channel_config_set_transfer_data_size(&data_cfg, DMA_SIZE_8);
+    channel_config_set_read_increment(&data_cfg, false);
+    channel_config_set_write_increment(&data_cfg, true);
+    channel_config_set_dreq(&data_cfg, DREQ_ADC);
+    channel_config_set_chain_to(&data_cfg, ctrl_chan);
+    dma_channel_configure(data_chan, &data_cfg, stream_addrs[0], &adc_hw->fifo, STREAM_PAYLOAD, false);
+
+    // Writes the next pass's address and triggers the data channel, whose
+    // transfer count reloads by itself
+    dma_channel_config ctrl_cfg = dma_channel_get_default_config(ctrl_chan);
+    channel_config_set_transfer_data_size(&ctrl_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&ctrl_cfg, true);
+    channel_config_set_write_increment(&ctrl_cfg, false);
+    channel_config_set_ring(&ctrl_cfg, false, __builtin_ctz(sizeof(stream_addrs)));
+    dma_channel_configure(ctrl_chan, &ctrl_cfg, &dma_channel_hw_addr(data_chan)->al2_write_addr_trig,
+                          &stream_addrs[1], 1, false);
+
+    dma_irqn_acknowledge_channel(STREAM_DMA_IRQ, data_chan);
+    dma_irqn_set_channel_enabled(STREAM_DMA_IRQ, data_chan, true);
+
+    // Full speed, round robin from the lowest channel, so each buffer starts with A
+    adc_set_clkdiv(0);
+    adc_select_input(channels & ADC_STREAM_CHANNEL_A ? 0 : 1);
+    adc_set_round_robin(channels);
+    dma_channel_start(data_chan);
+    adc_run(true);
+    active = true;
+    return true;
+}
+
+static void stream_stop(void)
+{
+    adc_run(false);
+
+    // Both at once, so the control channel can't retrigger the data one. The
+    // interrupt is off first, an abort can raise it (RP2040-E13)
+    uint32_t mask = (1u << data_chan) | (1u << ctrl_chan);
+    dma_irqn_set_channel_enabled(STREAM_DMA_IRQ, data_chan, false);
+    dma_hw->abort = mask;
+    while (dma_hw->abort & mask)
+        tight_loop_contents();
+    dma_irqn_acknowledge_channel(STREAM_DMA_IRQ, data_chan);
+
+    // Buffers still waiting for a pass or part filled go back, full ones still go out
+    for (int i = 0; i < ADC_STREAM_BUFFERS; i++)
+    {
+        if (buf_state[i] == BUF_DMA)
+            buf_state[i] = BUF_FREE;
+    }
+
+    // Back as the gates had it
+    adc_set_round_robin(0);
+    adc_fifo_drain();
+    adc_hw->div = saved_div;
+    active = false;
+}
+
+bool adc_stream_poll(void)
+{
+    int request = __atomic_exchange_n(&stream_request, -1, __ATOMIC_ACQUIRE);
+    if (request >= 0)
+    {
+        if (active)
+            stream_stop();
+        if (request > 0 && !stream_start(request))
+            printf("adc stream: no DMA channels\n");
+    }
+    return active;
+}
+
+bool adc_stream_active(void)
+{
+    return active;
+}
+
+// TinyUSB application class driver for the stream interface
+
+static void stream_driver_init(void)
+{
+}
+
+static void stream_driver_reset(uint8_t rhport)
+{
+    (void)rhport;
+    if (in_flight >= 0)
+        buf_state[in_flight] = BUF_FREE;
+    in_flight = -1;
+    stream_ep = 0;
+    // The host is gone, stop sampling for it
+    __atomic_store_n(&stream_request, 0, __ATOMIC_RELEASE);
+}
+
+static uint16_t stream_driver_open(uint8_t rhport, tusb_desc_interface_t const *itf, uint16_t max_len)
+{
+    uint16_t len = sizeof(tusb_desc_interface_t) + sizeof(tusb_desc_endpoint_t);
+    if (itf->bInterfaceClass != TUSB_CLASS_VENDOR_SPECIFIC || itf->bNumEndpoints != 1 || max_len < len)
+        return 0;
+    tusb_desc_endpoint_t const *ep = (tusb_desc_endpoint_t const *)tu_desc_next(itf);
+    if (tu_desc_type(ep) != TUSB_DESC_ENDPOINT || !usbd_edpt_open(rhport, ep))
+        return 0;
+    stream_rhport = rhport;
+    stream_ep = ep->bEndpointAddress;
+    return len;
+}
+
+static bool stream_driver_control(uint8_t rhport, uint8_t stage, tusb_control_request_t const *request)
+{
+    if (request->bmRequestType_bit.type != TUSB_REQ_TYPE_VENDOR)
+        return false;
+    if (stage != CONTROL_STAGE_SETUP)
+        return true;
+
+    const uint8_t all = ADC_STREAM_CHANNEL_A | ADC_STREAM_CHANNEL_B;
+    switch (request->bRequest)
+    {
+    case ADC_STREAM_REQUEST_START:
+        if (request->wValue == 0 || request->wValue & ~all)
+            return false;
+        __atomic_store_n(&stream_request, request->wValue, __ATOMIC_RELEASE);
+        break;
+    case ADC_STREAM_REQUEST_STOP:
+        __atomic_store_n(&stream_request, 0, __ATOMIC_RELEASE);
+        break;
+    default:
+        return false; // Stalls
+    }
+    // The main loop applies it
+    __sev();
+    return tud_control_status(rhport, request);
+}
+
+static bool stream_driver_xfer(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+{
+    (void)rhport;
+    (void)result;
+    (void)xferred_bytes;
+    if (ep_addr != stream_ep || in_flight < 0)
+        return false;
+    buf_state[in_flight] = BUF_FREE;
+    in_flight = -1;
+    stream_kick(NULL);
+    return true;
+}
+
+static const usbd_class_driver_t stream_driver = {
+#if CFG_TUSB_DEBUG >= 2
+    .name = "ADC stream",
+#endif
+    .init = stream_driver_init,
+    .reset = stream_driver_reset,
+    .open = stream_driver_open,
+    .control_xfer_cb = stream_driver_control,
+    .xfer_cb = stream_driver_xfer,
+    .sof = NULL,
+};
+
+usbd_class_driver_t const *usbd_app_driver_get_cb(uint8_t *driver_count)
+{
+    *driver_count = 1;
+    return &stream_driver;
+}
@@ -0,0 +1,55 @@
+#ifndef ADC_STREAM_H
+#define ADC_STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ Raw ADC stream over USB, to use the module as a scope on its CV inputs. The
+ ADC free-runs at its full 500ksps, round robin over the selected channels, and
+ DMA fills a ring of ADC_STREAM_BUFFERS buffers that go out as they are, no
+ copy, on a bulk IN endpoint of their own interface next to the stdio CDC one
+ (usb_descriptors.cpp). tools/adc_stream.py starts and stops it with vendor
+ requests on that interface and writes what it gets to disk.
+
+ Samples are 8 bit, as the gates capture them, so 500KB/s whatever the
+ channels: one channel gets all 500ksps, both 250ksps each, A first. Each
+ buffer starts with an adc_stream_header_t and holds a whole number of rounds.
+ When the host falls behind and the ring is full, buffers are dropped whole
+ and counted in the next header, so the gaps are known.
+
+ The ADC is the gates' while not streaming. Start and stop requests are taken
+ by the main loop between gates, and gates that come in while streaming are
+ not quantized, the outputs hold.
+*/
+
+#define ADC_STREAM_BUFFER_SIZE 4096 // Bytes, header included. A multiple of the 64 byte packets
+#ifndef ADC_STREAM_BUFFERS
+#define ADC_STREAM_BUFFERS 4        // 8ms each at 500ksps, set per board in CMakeLists.txt
+#endif
+#define ADC_STREAM_MAGIC 0x53415150 // "PQAS"
+#define ADC_STREAM_SAMPLE_RATE 500000
+
+// Vendor requests to the stream interface, wValue the channel mask for START
+#define ADC_STREAM_REQUEST_START 1
+#define ADC_STREAM_REQUEST_STOP 2
+#define ADC_STREAM_CHANNEL_A 0x01 // ADC input 0, GPIO 26
+#define ADC_STREAM_CHANNEL_B 0x02 // ADC input 1, GPIO 27
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t seq;         // Buffers numbered from 0 since the start, dropped ones included
+    uint32_t sample_rate; // ADC conversions a second, shared between the channels
+    uint8_t channels;     // ADC_STREAM_CHANNEL_ bits
+    uint8_t bits;         // Per sample, 8
+    uint16_t dropped;     // Buffers dropped just before this one
+} adc_stream_header_t;
+
+// The USB side, for the main loop: applies a start or stop the host asked for.
+// Returns true while streaming
+bool adc_stream_poll(void);
+
+bool adc_stream_active(void);
+
+#endif
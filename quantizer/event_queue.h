@@ -0,0 +1,72 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Lock-free single producer, single consumer queue, for handing events from an
+ IRQ handler to the main loop. Only the producer writes head and only the
+ consumer writes tail, each published with a release store after the slot is
+ filled or emptied, so neither side has to disable interrupts.
+*/
+
+// Power of two, so the indices can run freely and wrap. Set per board in CMakeLists.txt
+#ifndef EVENT_QUEUE_SIZE
+#define EVENT_QUEUE_SIZE 16
+#endif
+
+typedef struct
+{
+    uint8_t gpio;
+    uint32_t stamp;   // profiler_now() when the IRQ ran, 0 without the profiler
+    uint32_t time_us; // time_us_32() when the IRQ ran
+} event_t;
+
+typedef struct
+{
+    uint32_t head;    // Next slot to fill, written by the producer only
+    uint32_t tail;    // Next slot to empty, written by the consumer only
+    uint32_t dropped; // Events refused because the queue was full, producer only
+    event_t events[EVENT_QUEUE_SIZE];
+} event_queue_t;
+
+// Returns false, and counts the event as dropped, when the queue is full
+static inline bool event_queue_push(event_queue_t *queue, event_t event)
+{
+    uint32_t head = queue->head;
+    if (head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) == EVENT_QUEUE_SIZE)
+    {
+        queue->dropped++;
+        return false;
+    }
+    queue->events[head % EVENT_QUEUE_SIZE] = event;
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Returns false when there is nothing queued
+static inline bool event_queue_pop(event_queue_t *queue, event_t *event)
+{
+    uint32_t tail = queue->tail;
+    if (__atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == tail)
+        return false;
+    *event = queue->events[tail % EVENT_QUEUE_SIZE];
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Consumer side
+static inline bool event_queue_empty(const event_queue_t *queue)
+{
+    return __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == queue->tail;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <string.h>
+#include "profiler.h"
+#include "hardware/clocks.h"
+#include "hardware/irq.h"
+#include "hardware/timer.h"
+
+// Where the gate path runs from, see QUANTIZER_MEMORY in CMakeLists.txt
+#ifndef QUANTIZER_MEMORY
+#define QUANTIZER_MEMORY "flash"
+#endif
+// Chip and kernels, for comparing dumps from the same source on either board
+#if PICO_RP2350
+#define PROFILER_CHIP "RP2350"
+#else
+#define PROFILER_CHIP "RP2040"
+#endif
+#if defined(__ARM_FP)
+#define PROFILER_FLOAT "FPU"
+#else
+#define PROFILER_FLOAT "soft"
+#endif
+#if defined(__ARM_FEATURE_SIMD32)
+#define PROFILER_BURST_KERNEL "usada8"
+#else
+#define PROFILER_BURST_KERNEL "scalar"
+#endif
+
+#if QUANTIZER_HOT_IN_RAM
+#define PROFILER_HOT(func) __not_in_flash_func(func)
+#else
+#define PROFILER_HOT(func) func
+#endif
+
+static const char *stage_names[PROF_NUM_STAGES] = {
+    "handler",
+    "settle",
+    "capture",
+    "filter",
+    "quantize",
+    "dac",
+    "irq",
+    "queued",
+};
+
+static prof_stats_t stats[PROF_NUM_STAGES];
+static volatile uint32_t handler_start;
+static uint32_t handler_start_us;
+static volatile int last_stage = -1;  // Last stage completed inside the current handler
+static uint32_t budget_us;
+static uint32_t clk_sys_hz;
+static uint32_t budget_exceeded;      // Handlers that finished over budget
+static volatile uint32_t budget_alarms; // Alarms fired while a handler was still running
+static volatile int alarm_stage = -1; // Last completed stage when the alarm fired
+static int budget_alarm_num = -1;
+
+// Gate edge to DAC written, less the settle and capture waits, which the CV and
+// the ADC set rather than where the code runs. Cold and warm gates apart, and
+// split into the wait in the queue, which is down to the gates before, and the
+// path from the handler to the DAC, which is down to where the code runs
+static prof_stats_t latency[2]; // Edge to DAC, us, from time_us_32() so it can't wrap
+static prof_stats_t queued[2];  // Edge to handler, us
+static prof_stats_t path[2];    // Handler to DAC, cycles, well inside a SysTick wrap for a handler in budget
+static uint32_t gate_edge_us;
+static uint32_t gate_wait; // Settle and capture cycles of the gate in progress
+static bool gate_dac;      // Whether it has written the DAC, and when
+static uint32_t gate_dac_us;
+static uint32_t gate_dac_cycles;
+static bool gate_cold;
+static uint32_t last_gate_us;
+
+// Fires budget_us after a handler started if it has not returned yet
+static void budget_alarm_callback(uint alarm_num)
+{
+    budget_alarms++;
+    alarm_stage = last_stage;
+}
+
+// budget_us is the longest a gate handler should take, settle and capture included
+void profiler_init(uint32_t handler_budget_us)
+{
+    // SysTick free running from the processor clock, no interrupt
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0b101; // CLKSOURCE | ENABLE
+
+    clk_sys_hz = clock_get_hz(clk_sys);
+    budget_us = handler_budget_us;
+
+    // The alarm has to preempt the gate processing it is watching. The gate IRQ
+    // shares its priority, it only queues the edge
+    budget_alarm_num = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(budget_alarm_num, budget_alarm_callback);
+    irq_set_priority(hardware_alarm_get_irq_num(budget_alarm_num), PICO_HIGHEST_IRQ_PRIORITY);
+
+    profiler_reset();
+}
+
+void profiler_reset(void)
+{
+    memset(stats, 0, sizeof(stats));
+    for (int i = 0; i < PROF_NUM_STAGES; i++)
+    {
+        stats[i].min = UINT32_MAX;
+    }
+    memset(latency, 0, sizeof(latency));
+    memset(queued, 0, sizeof(queued));
+    memset(path, 0, sizeof(path));
+    for (int i = 0; i < 2; i++)
+    {
+        latency[i].min = queued[i].min = path[i].min = UINT32_MAX;
+    }
+    budget_exceeded = 0;
+    budget_alarms = 0;
+}
+
+static void PROFILER_HOT(stats_add)(prof_stats_t *s, uint32_t cycles)
+{
+    s->count++;
+    s->total += cycles;
+    s->min = MIN(s->min, cycles);
+    s->max = MAX(s->max, cycles);
+
+    int bucket = cycles ? 31 - __builtin_clz(cycles) : 0;
+    s->hist[MIN(bucket, PROF_HIST_BUCKETS - 1)]++;
+}
+
+void PROFILER_HOT(profiler_record)(prof_stage_t stage, uint32_t cycles)
+{
+    stats_add(&stats[stage], cycles);
+    if (stage == PROF_STAGE_SETTLE || stage == PROF_STAGE_CAPTURE)
+        gate_wait += cycles;
+
+    // The latency ends here, not at the handler's exit, past its stdio prints
+    if (stage == PROF_STAGE_DAC)
+    {
+        gate_dac = true;
+        gate_dac_us = time_us_32();
+        gate_dac_cycles = profiler_elapsed(handler_start);
+    }
+
+    // The gate IRQ records too, in the middle of whichever handler it preempts
+    if (stage != PROF_STAGE_IRQ)
+        last_stage = stage;
+}
+
+// In cycles like the rest, saturating, 34s at 125MHz
+void PROFILER_HOT(profiler_record_us)(prof_stage_t stage, uint32_t us)
+{
+    uint64_t cycles = (uint64_t)us * clk_sys_hz / 1000000;
+    profiler_record(stage, (uint32_t)MIN(cycles, UINT32_MAX));
+}
+
+// edge_us is time_us_32() at the gate edge, called as the handler starts
+void PROFILER_HOT(profiler_gate_edge)(uint32_t edge_us)
+{
+    uint32_t now_us = time_us_32();
+    gate_edge_us = edge_us;
+    gate_wait = 0;
+    gate_cold = now_us - last_gate_us > PROF_COLD_IDLE_US;
+    stats_add(&queued[gate_cold ? 0 : 1], now_us - edge_us);
+}
+
+void PROFILER_HOT(profiler_handler_enter)(void)
+{
+    last_stage = -1;
+    gate_dac = false;
+    handler_start = profiler_now();
+    handler_start_us = time_us_32();
+    hardware_alarm_set_target(budget_alarm_num, make_timeout_time_us(budget_us));
+}
+
+void PROFILER_HOT(profiler_handler_exit)(void)
+{
+    hardware_alarm_cancel(budget_alarm_num);
+    // A handler blocked on USB stdio can outlast a SysTick wrap, 134ms at
+    // 125MHz. SysTick's cycles while it can't have, time_us_32() beyond
+    uint32_t now_us = time_us_32();
+    uint32_t handler_us = now_us - handler_start_us;
+    uint32_t cycles = profiler_elapsed(handler_start);
+    if (handler_us >= 100000)
+        cycles = (uint32_t)MIN((uint64_t)handler_us * clk_sys_hz / 1000000, UINT32_MAX);
+    profiler_record(PROF_STAGE_HANDLER, cycles);
+    if (gate_dac)
+    {
+        uint32_t wait_us = (uint32_t)((uint64_t)gate_wait * 1000000 / clk_sys_hz);
+        stats_add(&latency[gate_cold ? 0 : 1], gate_dac_us - gate_edge_us - wait_us);
+        stats_add(&path[gate_cold ? 0 : 1], gate_dac_cycles - gate_wait);
+    }
+    last_gate_us = now_us;
+
+    if (handler_us > budget_us)
+    {
+        budget_exceeded++;
+        printf("BUDGET ALARM: handler took %uus (budget %uus), alarm after stage %s\n",
+               handler_us, budget_us, alarm_stage >= 0 ? stage_names[alarm_stage] : "entry");
+    }
+    alarm_stage = -1;
+}
+
+// per_us converts the stats to us
+static void print_latency(const char *name, const prof_stats_t *s, float per_us)
+{
+    if (s->count == 0)
+    {
+        printf("%-11s %8u\n", name, 0);
+        return;
+    }
+    printf("%-11s %8u %10.1f %10.1f %10.1f %10.1f\n", name, s->count, s->min / per_us,
+           s->total / s->count / per_us, s->max / per_us, (s->max - s->min) / per_us);
+}
+
+void profiler_dump(void)
+{
+    float cycles_per_us = clock_get_hz(clk_sys) / 1000000.0f;
+
+    printf("--- profile (clk_sys %0.1fMHz, code in %s, budget %uus) ---\n", cycles_per_us, QUANTIZER_MEMORY,
+           budget_us);
+    printf("chip %s, float %s, burst sum %s\n", PROFILER_CHIP, PROFILER_FLOAT, PROFILER_BURST_KERNEL);
+    printf("budget exceeded: %u, budget alarms: %u\n", budget_exceeded, budget_alarms);
+    printf("%-9s %8s %10s %10s %10s   (cycles)\n", "stage", "count", "min", "avg", "max");
+    for (int i = 0; i < PROF_NUM_STAGES; i++)
+    {
+        prof_stats_t *s = &stats[i];
+        if (s->count == 0)
+        {
+            printf("%-9s %8u\n", stage_names[i], 0);
+            continue;
+        }
+        printf("%-9s %8u %10u %10u %10u   (%0.1fus max)\n", stage_names[i], s->count,
+               s->min, (uint32_t)(s->total / s->count), s->max, s->max / cycles_per_us);
+    }
+
+    // First gate after PROF_COLD_IDLE_US idle against the ones that follow it.
+    // Edge is the whole of it, queued and path its two parts
+    printf("gate latency less settle and capture (us)\n");
+    printf("%-11s %8s %10s %10s %10s %10s\n", "", "count", "min", "avg", "max", "jitter");
+    for (int i = 0; i < 2; i++)
+    {
+        print_latency(i ? "warm edge" : "cold edge", &latency[i], 1.0f);
+        print_latency(i ? "warm queued" : "cold queued", &queued[i], 1.0f);
+        print_latency(i ? "warm path" : "cold path", &path[i], cycles_per_us);
+    }
+
+    // One line per stage, "bucket:count" for each non empty power of two bucket
+    printf("histogram (log2 cycles:count)\n");
+    for (int i = 0; i < PROF_NUM_STAGES; i++)
+    {
+        printf("%-9s", stage_names[i]);
+        for (int b = 0; b < PROF_HIST_BUCKETS; b++)
+        {
+            if (stats[i].hist[b])
+                printf(" %d:%u", b, stats[i].hist[b]);
+        }
+        printf("\n");
+    }
+    printf("--- end profile ---\n");
+}
+
+// Commands over USB serial, one character read by the caller's main loop:
+// p = dump the statistics
+// r = reset the statistics
+void profiler_command(int c)
+{
+    if (c == 'p')
+        profiler_dump();
+    else if (c == 'r')
+    {
+        profiler_reset();
+        printf("profile reset\n");
+    }
+}
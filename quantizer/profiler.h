@@ -0,0 +1,84 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "pico/stdlib.h"
+#include "hardware/structs/systick.h"
+
+// Set to 0 to compile all the instrumentation out
+#define PROFILER_ENABLED 1
+
+// Histogram buckets are powers of two of cycles, bucket i holds [2^i, 2^(i+1))
+// 24 would cover the 24 bit SysTick counter, the queue wait is timed in us and
+// converted, so it can run past that
+#define PROF_HIST_BUCKETS 32
+
+// A gate handler's time beyond its settle and capture waits, before the budget
+// alarm. The budget itself is the caller's, from its longest waits
+#define PROF_HANDLER_MARGIN_US 5000
+
+// A gate after this long without one is counted as cold, the XIP cache has
+// likely lost the gate path code by then if it runs from flash
+#define PROF_COLD_IDLE_US 1000000
+
+// Stages of the gate path
+typedef enum
+{
+    PROF_STAGE_HANDLER,  // Whole gate event in the main loop, dequeue to DAC written
+    PROF_STAGE_SETTLE,   // Waiting for the CV to stabilise
+    PROF_STAGE_CAPTURE,  // DMA burst capture
+    PROF_STAGE_FILTER,   // Burst estimator
+    PROF_STAGE_QUANTIZE, // Table search and scale snapping
+    PROF_STAGE_DAC,      // SPI write to the DAC
+    PROF_STAGE_IRQ,      // Gate IRQ, queueing the edge
+    PROF_STAGE_QUEUE,    // Gate edge waiting in the queue for the main loop
+    PROF_NUM_STAGES
+} prof_stage_t;
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t hist[PROF_HIST_BUCKETS];
+} prof_stats_t;
+
+void profiler_init(uint32_t budget_us);
+void profiler_reset(void);
+void profiler_record(prof_stage_t stage, uint32_t cycles);
+void profiler_record_us(prof_stage_t stage, uint32_t us);
+void profiler_gate_edge(uint32_t edge_us);
+void profiler_handler_enter(void);
+void profiler_handler_exit(void);
+void profiler_dump(void);
+void profiler_command(int c);
+
+// SysTick counts down from 0xFFFFFF at clk_sys
+static inline uint32_t profiler_now(void)
+{
+    return systick_hw->cvr;
+}
+
+static inline uint32_t profiler_elapsed(uint32_t start)
+{
+    return (start - systick_hw->cvr) & 0x00FFFFFF;
+}
+
+#if PROFILER_ENABLED
+#define PROFILE_BEGIN(var) uint32_t var = profiler_now()
+#define PROFILE_END(stage, var) profiler_record(stage, profiler_elapsed(var))
+// For spans that can outlast a SysTick wrap, 134ms at 125MHz, from a time_us_32()
+#define PROFILE_END_US(stage, start_us) profiler_record_us(stage, time_us_32() - (start_us))
+#define PROFILE_GATE_EDGE(edge_us) profiler_gate_edge(edge_us)
+#define PROFILE_HANDLER_ENTER() profiler_handler_enter()
+#define PROFILE_HANDLER_EXIT() profiler_handler_exit()
+#else
+#define PROFILE_BEGIN(var)
+#define PROFILE_END(stage, var)
+#define PROFILE_END_US(stage, start_us)
+#define PROFILE_GATE_EDGE(edge_us)
+#define PROFILE_HANDLER_ENTER()
+#define PROFILE_HANDLER_EXIT()
+#endif
+
+#endif
@@ -0,0 +1,226 @@
+#include <math.h>
+#include <string.h>
+#include "quantize.h"
+#if defined(__ARM_FEATURE_SIMD32)
+#include <arm_acle.h>
+#endif
+
+void generateFrequencies(float *frequencies)
+{
+    float freq = (float)FREQ_0V;
+
+    for (int i = 0; i < NUM_PIANO_KEYS; i++)
+    {
+        freq = FREQ_0V * pow(pow(2, VOLT_PER_SEMITONE), i);
+        frequencies[i] = roundf(freq * 1000) / 1000;
+    }
+}
+
+void generateVoltages(float *voltages)
+{
+    for (int i = 0; i < NUM_PIANO_KEYS; i++)
+    {
+        float volt = VOLT_PER_SEMITONE * i;
+        voltages[i] = volt;
+    }
+}
+
+// Sum of n samples. With the Armv8-M DSP extension (RP2350) USADA8 adds four
+// at a time, the RP2040's M0+ has no SIMD and takes them one by one
+static inline uint32_t burst_sum(const uint8_t *samples, size_t n)
+{
+    uint32_t sum = 0;
+    size_t i = 0;
+#if defined(__ARM_FEATURE_SIMD32)
+    for (; i + 4 <= n; i += 4)
+    {
+        uint32_t four;
+        memcpy(&four, samples + i, 4); // The M33 loads unaligned words
+        sum = __usada8(four, 0, sum);
+    }
+#endif
+    for (; i < n; i++)
+    {
+        sum += samples[i];
+    }
+    return sum;
+}
+
+float QUANTIZE_HOT(estimate_burst)(const uint8_t *capture_buf, size_t n)
+{
+#if BURST_FILTER == BURST_FILTER_MEAN
+    return (float)burst_sum(capture_buf, n) / n;
+#else
+    // Insertion sort a copy, the burst is only a handful of samples
+    uint8_t sorted[BURST_MAX_SAMP];
+    if (n > BURST_MAX_SAMP)
+        n = BURST_MAX_SAMP;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint8_t value = capture_buf[i];
+        size_t j = i;
+        for (; j > 0 && sorted[j - 1] > value; j--)
+        {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = value;
+    }
+
+#if BURST_FILTER == BURST_FILTER_MEDIAN
+    if (n % 2 == 0)
+        return (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0f;
+    return sorted[n / 2];
+#else
+    size_t trim = n * BURST_TRIM_PERCENT / 100;
+    return (float)burst_sum(sorted + trim, n - 2 * trim) / (n - 2 * trim);
+#endif
+#endif
+}
+
+int QUANTIZE_HOT(quantizeValue)(float x, const float *values)
+{
+    int n = NUM_PIANO_KEYS;
+    int l = 0;     // lower limit
+    int u = n - 1; // upper limit
+
+    if (x <= values[0])
+        return 0;
+    else if (x >= values[u])
+        return u;
+
+    while (u - l > 1)
+    {
+        int midPoint = (u + l) >> 1;
+        if (x == values[midPoint])
+            return midPoint;
+        else if (x > values[midPoint])
+            l = midPoint;
+        else
+            u = midPoint;
+    }
+
+    return l;
+}
+
+int quantizeToScale(int quantized_idx, uint16_t scale)
+{
+    scale &= 0xFFF;
+    if (scale == 0 || quantized_idx < 0 || quantized_idx >= NUM_PIANO_KEYS)
+        return -1;
+    if (scale & (1 << (quantized_idx % 12)))
+        return quantized_idx;
+
+    // The enabled notes either side, within an octave and the range
+    int down = -1;
+    int up = -1;
+    for (int i = 1; i < 12 && (down < 0 || up < 0); i++)
+    {
+        int below = quantized_idx - i;
+        int above = quantized_idx + i;
+        if (down < 0 && below >= 0 && (scale & (1 << (below % 12))))
+            down = below;
+        if (up < 0 && above < NUM_PIANO_KEYS && (scale & (1 << (above % 12))))
+            up = above;
+    }
+
+#if SNAP_POLICY == SNAP_UP
+    return up >= 0 ? up : down;
+#elif SNAP_POLICY == SNAP_NEAREST
+    if (down < 0 || (up >= 0 && up - quantized_idx < quantized_idx - down))
+        return up;
+    return down;
+#else
+#if SNAP_BOTTOM == SNAP_BOTTOM_UP
+    if (down < 0)
+        return up;
+#endif
+    return down;
+#endif
+}
+
+void snap_table_build(snap_table_t *table, uint16_t scale)
+{
+    table->scale = scale;
+    for (int i = 0; i < NUM_PIANO_KEYS; i++)
+    {
+        table->note[i] = quantizeToScale(i, scale);
+    }
+}
+
+static uint16_t read_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+size_t tuning_table_size(const uint8_t *header)
+{
+    if (header[0] != 'P' || header[1] != 'Q' || header[2] != 'T' || header[3] != 'T')
+        return 0;
+    return TUNING_HEADER_SIZE + (size_t)read_u16(header + 6) * TUNING_NOTE_SIZE;
+}
+
+int tuning_load(tuning_t *tuning, const uint8_t *table, size_t len, uint16_t vmax_mv, uint16_t dac_max)
+{
+    if (len < TUNING_HEADER_SIZE || tuning_table_size(table) != len || table[4] != TUNING_VERSION)
+        return -1;
+
+    uint16_t num_notes = read_u16(table + 6);
+    uint8_t degrees = table[5];
+    if (num_notes == 0 || num_notes > TUNING_MAX_NOTES || degrees == 0)
+        return -1;
+
+    uint16_t checksum = 0;
+    for (size_t i = TUNING_HEADER_SIZE; i < len; i++)
+    {
+        checksum += table[i];
+    }
+    if (checksum != read_u16(table + 12))
+        return -1;
+    if (read_u16(table + 8) != vmax_mv || read_u16(table + 10) != dac_max)
+        return -2;
+
+    const uint8_t *note = table + TUNING_HEADER_SIZE;
+    for (int i = 0; i < num_notes; i++, note += TUNING_NOTE_SIZE)
+    {
+        tuning->notes[i].input_mv = read_u16(note);
+        tuning->notes[i].dac_code = read_u16(note + 2);
+        tuning->notes[i].degree = note[4];
+        // Ranges have to go up, and the degree index the mask
+        if (note[4] >= degrees || (i > 0 && tuning->notes[i].input_mv < tuning->notes[i - 1].input_mv))
+            return -1;
+    }
+    tuning->num_notes = num_notes;
+    tuning->degrees = degrees;
+    tuning->vmax_mv = vmax_mv;
+    tuning->dac_max = dac_max;
+    return 0;
+}
+
+void tuning_apply_scale(tuning_t *tuning, uint16_t scale, float volts_per_step)
+{
+    // Each note snapped onto the scale first, then the steps walked up through the
+    // ranges. Static, TUNING_MAX_NOTES entries are a lot of stack, calls are never concurrent
+    static int16_t snapped[TUNING_MAX_NOTES];
+    for (int i = 0; i < tuning->num_notes; i++)
+    {
+        snapped[i] = -1;
+        for (int j = i; j >= 0 && j > i - tuning->degrees; j--)
+        {
+            uint8_t degree = tuning->notes[j].degree;
+            if (degree >= 12 || (scale & (1 << degree)))
+            {
+                snapped[i] = j;
+                break;
+            }
+        }
+    }
+
+    int note = -1;
+    for (int step = 0; step < TUNING_INPUT_STEPS; step++)
+    {
+        float mv = step * volts_per_step * 1000;
+        while (note + 1 < tuning->num_notes && tuning->notes[note + 1].input_mv <= mv)
+            note++;
+        tuning->lookup[step] = note < 0 ? -1 : snapped[note];
+    }
+}
@@ -0,0 +1,156 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ The quantizer's note tables, burst filter and scale snapping, with nothing
+ Pico specific so the host build (host/CMakeLists.txt) runs the same code as the
+ firmware.
+*/
+
+// Gate path functions, put in RAM by the quantizer's "hot" memory profile
+// (QUANTIZER_MEMORY in CMakeLists.txt). The section is the one the SDK's
+// __not_in_flash_func() uses, spelt out so the host build needs no SDK headers
+#if QUANTIZER_HOT_IN_RAM
+#define QUANTIZE_HOT(func) __attribute__((section(".time_critical." #func))) func
+#else
+#define QUANTIZE_HOT(func) func
+#endif
+
+#define VOLT_PER_SEMITONE (1.0 / 12.0)
+#define FREQ_0V 16.35 // Frequency at 0V is equal to C0
+#define NUM_PIANO_KEYS (6 * 12)
+
+// How a burst of samples is reduced to one value
+// 0 = Mean
+// 1 = Median
+// 2 = Trimmed mean (drops BURST_TRIM_PERCENT of the samples at each end)
+#define BURST_FILTER_MEAN 0
+#define BURST_FILTER_MEDIAN 1
+#define BURST_FILTER_TRIMMED_MEAN 2
+#ifndef BURST_FILTER
+#define BURST_FILTER BURST_FILTER_MEDIAN
+#endif
+#define BURST_TRIM_PERCENT 20
+#define BURST_MAX_SAMP 64 // Longest burst estimate_burst() takes
+
+// Frequencies of each actual note starting from FREQ_0V, NUM_PIANO_KEYS of them
+void generateFrequencies(float *frequencies);
+
+// Voltages of each actual note starting from 0V, NUM_PIANO_KEYS of them
+void generateVoltages(float *voltages);
+
+// Reduces a burst of n 8 bit samples to a single value in ADC counts
+float estimate_burst(const uint8_t *capture_buf, size_t n);
+
+// Returns the index of the value closest to x in values ("rounded" down),
+// clamped to the first and last of the NUM_PIANO_KEYS
+int quantizeValue(float x, const float *values);
+
+// Where a note that isn't in the scale goes
+#define SNAP_DOWN 0    // The enabled note below
+#define SNAP_UP 1      // The enabled note above, or below at the top of the range
+#define SNAP_NEAREST 2 // Whichever is closer, down on a tie
+#ifndef SNAP_POLICY
+#define SNAP_POLICY SNAP_DOWN
+#endif
+
+// What SNAP_DOWN does below the lowest enabled note
+#define SNAP_BOTTOM_HOLD 0 // Nothing, the previous output is kept
+#define SNAP_BOTTOM_UP 1   // The lowest enabled note
+#ifndef SNAP_BOTTOM
+#define SNAP_BOTTOM SNAP_BOTTOM_HOLD
+#endif
+
+/*
+ Moves a note index onto the scale by SNAP_POLICY and SNAP_BOTTOM, bit n of
+ scale enabling the notes with index n mod 12. Returns the index, or -1 when
+ there is no enabled note to go to, in which case the previous output should
+ be kept. This searches, the gate path reads a snap_table_t instead
+*/
+int quantizeToScale(int quantized_idx, uint16_t scale);
+
+// quantizeToScale() of every note index for one scale, rebuilt when the scale
+// changes so a gate snaps with a single load
+typedef struct
+{
+    uint16_t scale;
+    int8_t note[NUM_PIANO_KEYS]; // -1 to keep the previous note
+} snap_table_t;
+
+void snap_table_build(snap_table_t *table, uint16_t scale);
+
+static inline int snap_note(const snap_table_t *table, int quantized_idx)
+{
+    return table->note[quantized_idx];
+}
+
+/*
+ Tunings compiled from Scala files by tools/scala_table.py. The table holds
+ each note's input range and DAC code, and tuning_apply_scale() expands it into
+ a lookup by input step with the scale mask already applied, so quantizing is
+ a single read whatever the tuning.
+*/
+
+#define TUNING_VERSION 1
+#define TUNING_HEADER_SIZE 16
+#define TUNING_NOTE_SIZE 6
+#define TUNING_MAX_NOTES 256
+// Input steps of the lookup, half ADC counts as the median of an even burst lands on .5
+#define TUNING_INPUT_STEPS 512
+
+typedef struct
+{
+    uint16_t input_mv; // Lowest input that quantizes to this note
+    uint16_t dac_code;
+    uint8_t degree; // Within the period, bit n of the scale mask enables degree n
+} tuning_note_t;
+
+typedef struct
+{
+    uint16_t num_notes;
+    uint8_t degrees; // Notes per period
+    uint16_t vmax_mv;
+    uint16_t dac_max;
+    tuning_note_t notes[TUNING_MAX_NOTES];
+    int16_t lookup[TUNING_INPUT_STEPS]; // Note per input step, -1 to keep the previous one
+} tuning_t;
+
+/*
+ Checks and unpacks a table. vmax_mv and dac_max are the output the firmware
+ drives, a table made for another DAC is refused.
+ Returns 0, or -1 for a malformed table and -2 for a mismatched one
+*/
+int tuning_load(tuning_t *tuning, const uint8_t *table, size_t len, uint16_t vmax_mv, uint16_t dac_max);
+
+// Bytes of a table with the header at table, 0 if it isn't one
+size_t tuning_table_size(const uint8_t *header);
+
+/*
+ Fills the lookup for input step i at i * volts_per_step. Degrees past the 12
+ mask bits are always enabled, and a disabled note moves down to the enabled
+ one below it within a period, as SNAP_DOWN does, whatever SNAP_POLICY
+*/
+void tuning_apply_scale(tuning_t *tuning, uint16_t scale, float volts_per_step);
+
+// Note for an input in steps, -1 to keep the previous note
+static inline int tuning_quantize(const tuning_t *tuning, float steps)
+{
+    int i = (int)steps;
+    if (i < 0)
+        i = 0;
+    if (i >= TUNING_INPUT_STEPS)
+        i = TUNING_INPUT_STEPS - 1;
+    return tuning->lookup[i];
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
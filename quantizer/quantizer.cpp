@@ -1,12 +1,27 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include "pico/stdlib.h"
 #include "hardware/dma.h"
 #include "hardware/adc.h"
 #include "hardware/pio.h"
 #include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/timer.h"
+#include "hardware/clocks.h"
+#include "hardware/vreg.h"
 #include "hardware/pwm.h"
 #include "hardware/spi.h"
+#include "hardware/sync.h"
+#include "profiler.h"
+#include "quantize.h"
+#include "event_queue.h"
+#include "recorder.h"
+#include "sd_out.h"
+#include "adc_stream.h"
+#if QUANTIZER_TUNING_DEFAULT
+#include "tuning_default.h" // Generated from QUANTIZER_SCALA, see CMakeLists.txt
+#endif
 
 // PIN INPUT
 #define GATE_PIN_A 20
@@ -25,11 +40,21 @@
 #define NOTE_PIN_11 10 // A#
 #define NOTE_PIN_12 11 // B
 
+// The note pins are consecutive from NOTE_PIN_01
+#define GATE_PIN_MASK ((1u << GATE_PIN_A) | (1u << GATE_PIN_B))
+#define NOTE_PIN_MASK (0xFFFu << NOTE_PIN_01)
+
+// The gates have IO_IRQ_BANK0 to themselves at the highest priority. The note
+// switches are polled from a hardware alarm at the lowest priority instead, so
+// however they bounce they can't delay a gate by more than the gate IRQ itself
+#define SCALE_POLL_US 5000 // A change is taken once it has held for two polls
+
 #define ADC_CAPTURE_CHANNEL_1 0 // 26 + 0
 #define ADC_CAPTURE_CHANNEL_2 1 // 26 + 1
 
 // DAC OUTPUT
 #define SPI_VMAX 5.0f
+#define DAC_MAX_CODE 1023 // 10 bit MCP4911
 #define SPI_A_PORT spi0
 #define OUT_A_LDAC 16
 #define OUT_A_CS 17
@@ -42,14 +67,32 @@
 #define OUT_B_SCK 14
 #define OUT_B_SDI 15
 
+// Where each channel's CV goes: the MCP4911 on its SPI port, a PIO sigma-delta
+// pin with an RC filter (sd_out.h) for builds without the DACs, or both, the
+// pin mirroring its channel's DAC: two CVs, each on two jacks. DAC_write() and
+// DAC_write_code() take care of either
+#define OUTPUT_DAC 1
+#define OUTPUT_SD 2
+#define OUTPUT_ENGINE OUTPUT_DAC
+#define OUT_A_SD_PIN 22
+#define OUT_B_SD_PIN 28
+
+// Prints each SPI write's code and bits once LDAC has latched it. Off by
+// default, it puts USB stdio on the gate path that the profiler times
+#define DAC_PRINT_WRITES 0
+
 #define LED_PIN 25
 
+// clk_sys in kHz, 0 leaves the SDK default (125MHz RP2040, 150MHz RP2350). Set by QUANTIZER_CLK_SYS_KHZ
+// in CMakeLists.txt, along with QUANTIZER_MEMORY for where the gate path runs from
+#ifndef CLK_SYS_KHZ
+#define CLK_SYS_KHZ 0
+#endif
+#define CLK_SYS_VREG_ABOVE_KHZ 200000 // Faster than this gets VREG_VOLTAGE_1_15
+
 #define INPUT_VOLTAGE_DIVISION (0.333)
 #define VOLT_MAX 3.3f // Maximum input voltage
 
-#define VOLT_PER_SEMITONE (1.0 / 12.0)
-#define FREQ_0V 16.35 // Frequency at 0V is equal to C0
-#define NUM_PIANO_KEYS 6 * 12
 
 // set this to determine sample rate
 // 96     = 500,000 Hz
@@ -58,32 +101,173 @@
 #define FSAMP 5000 // Hz
 #define CLOCK_DIV (48000000 / FSAMP)
 
-// BE CAREFUL: anything over about 9000 here will cause things
-// to silently break. The code will compile and upload, but due
-// to memory issues nothing will work properly
-#define NSAMP 10
+// Maximum burst length, the adaptive mode may stop earlier. Set by QUANTIZER_NSAMP
+// in CMakeLists.txt, where tools/mem_budget.py checks the RAM left after the link
+// and reports how far it can grow
+#ifndef NSAMP
+#define NSAMP 16
+#endif
+
+#if NSAMP > BURST_MAX_SAMP
+#error "estimate_burst() takes at most BURST_MAX_SAMP samples"
+#endif
+
+// BURST_FILTER in quantize.h sets how a burst is reduced to one value
+
+// Adaptive burst length: stop sampling as soon as the variance of the estimate
+// (sample variance / n, in ADC counts^2) drops below the threshold.
+// One semitone is roughly 2 counts, so 0.05 keeps the estimate well inside a note.
+#define BURST_ADAPTIVE 1
+#define BURST_MIN_SAMP 4
+#define BURST_VARIANCE_THRESHOLD 0.05f
+
+// Settling after a gate before the burst is captured
+// 0 = Fixed sleep of SETTLE_FIXED_MS
+// 1 = Adaptive, reads the CV continuously and releases once its slope is flat
+#define SETTLE_ADAPTIVE 1
+#define SETTLE_FIXED_MS 10
+#define SETTLE_TIMEOUT_US 30000   // Give up waiting on slow slews after this long
+#define SETTLE_INTERVAL_US 250    // Slope is measured between readings this far apart
+#define SETTLE_READ_AVG 4         // adc_read()s averaged into each reading
+#define SETTLE_SLOPE_THRESHOLD 4  // Max change in 12 bit counts per interval (~1/8 semitone)
+#define SETTLE_STABLE_COUNT 2     // Flat intervals in a row needed to release
+
+// Longest a gate handler should take, for the profiler's budget alarm: the
+// longest settle, a full burst and PROF_HANDLER_MARGIN_US for the rest
+#if SETTLE_ADAPTIVE
+#define HANDLER_BUDGET_US (SETTLE_TIMEOUT_US + NSAMP * 1000000 / FSAMP + PROF_HANDLER_MARGIN_US)
+#else
+#define HANDLER_BUDGET_US (SETTLE_FIXED_MS * 1000 + NSAMP * 1000000 / FSAMP + PROF_HANDLER_MARGIN_US)
+#endif
+
+// Scala tunings (tools/scala_table.py). Sending TUNING_UPLOAD_CHAR followed by a
+// table switches to it, TUNING_RESET_CHAR goes back to 12-TET
+#define TUNING_UPLOAD_CHAR 't'
+#define TUNING_RESET_CHAR 'e'
+#define TUNING_UPLOAD_TIMEOUT_US 1000000 // Between bytes of the upload
+
+// Gate recorder (recorder.h), RECORDER_DUMP_CHAR sends it all for host/python/replay_recording.py
+#define RECORDER_DUMP_CHAR 'd'
+#define RECORDER_CLEAR_CHAR 'c'
+
+// What happens to a gate edge that arrives while the last one on its channel is
+// still queued or being quantized, an overrun
+#define GATE_POLICY_DROP 0   // Ignored, the gate in hand stands
+#define GATE_POLICY_LATEST 1 // One gate queued per channel, later edges replace it
+#define GATE_POLICY_QUEUE 2  // Every edge queued, dropped only when the queue is full
+#define GATE_POLICY GATE_POLICY_QUEUE
+#define GATE_STATS_CHAR 'o'  // Prints the per channel counters
+
+// Stress test: edges injected on one channel at a time from a hardware alarm, at
+// each of STRESS_RATES_HZ for STRESS_STEP_MS, until a rate overruns. Disconnect
+// the gate inputs first, real edges are counted too
+#define GATE_STRESS_CHAR 's'
+#define STRESS_STEP_MS 2000
+#define STRESS_RATES_HZ {2, 5, 10, 20, 30, 50, 75, 100, 150, 200, 300, 500, 1000}
 
 static float FREQUENCIES[NUM_PIANO_KEYS]; // Frequencies of each actual note starting from FREQ_0V
 static float VOLTAGES[NUM_PIANO_KEYS];    // Voltages of each actual note starting from 0V
 dma_channel_config cfg;
 uint dma_chan;
-uint8_t cap_buf[NSAMP];
+// DMA target in scratch X, off the striped main SRAM banks the CPU is working in
+uint8_t __scratch_x("cap_buf") cap_buf[NSAMP];
 static char event_str[128];
 uint16_t defined_scale;
+// defined_scale's snapping of every note, see SNAP_POLICY in quantize.h
+static snap_table_t snap_table;
+
+// Tuning lookups, one in use and one to load the next table into, so a bad
+// upload leaves the current one alone. NULL for the 12-TET VOLTAGES path
+static tuning_t tunings[2];
+static tuning_t *tuning = NULL;
+
+// Edges queued by gate_irq_handler() and scale_poll() for the main loop, which does all the work
+static event_queue_t gate_events;
+static event_queue_t scale_events;
+static int scale_poll_alarm = -1;
+static uint32_t scale_pins;        // Note pins at the last poll
+static bool scale_pins_queued;     // scale_pins has been queued already
+
+// Per gate channel bookkeeping for GATE_POLICY. Like the queue, each field has a
+// single writer, so neither side has to disable interrupts
+typedef struct
+{
+    // Written by gate_edge() only
+    uint32_t edges;      // Every edge seen
+    uint32_t pushed;     // Edges queued
+    uint32_t overruns;   // Edges that came while the previous gate was still queued or in progress
+    uint32_t dropped;    // Edges thrown away, by GATE_POLICY_DROP or a full queue
+    uint32_t coalesced;  // Edges folded into the one queued, GATE_POLICY_LATEST
+    uint32_t latest_seq; // Bumped each time latest is replaced
+    event_t latest;      // Newest edge coalesced behind the queued one
+    // Written by the main loop only
+    uint32_t popped; // Gates taken off the queue
+    uint32_t done;   // Gates quantized
+    uint32_t latest_taken; // latest_seq last used
+} gate_channel_t;
+static gate_channel_t gate_channels[2];
+
+static const uint16_t stress_rates_hz[] = STRESS_RATES_HZ;
+#define STRESS_STEPS (sizeof(stress_rates_hz) / sizeof(stress_rates_hz[0]))
+
+typedef struct
+{
+    int channel; // Channel being driven, -1 when the test isn't running
+    uint step;   // Into stress_rates_hz
+    uint32_t period_us;
+    uint32_t edges_left;
+    uint64_t next_us;
+    volatile bool step_done;
+    gate_channel_t start; // Counters when the step began
+    uint16_t max_hz[2];   // Highest rate without an overrun, 0 for none
+} stress_t;
+static stress_t stress = {-1};
+static int stress_alarm = -1;
+
+// Settle times actually achieved, per capture channel
+typedef struct
+{
+    uint32_t count;
+    uint32_t timeouts;
+    uint32_t last_us;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+} settle_stats_t;
+static settle_stats_t settle_stats[2] = {{0, 0, 0, UINT32_MAX, 0, 0}, {0, 0, 0, UINT32_MAX, 0, 0}};
 
 const float conversion_factor = VOLT_MAX / (1 << 8); // 256 bit, for DMA ADC conversion
 // const float conversion_factor = VOLT_MAX / (1 << 12); // for ADC_read conversion
+// Input voltage per ADC count, folded at compile time so the gate path does one
+// float multiply rather than a double division, which no FPU helps with
+const float adc_volts_per_count = conversion_factor / INPUT_VOLTAGE_DIVISION;
+// Input voltage per tuning lookup step, which are half ADC counts
+const float tuning_volts_per_step = conversion_factor / INPUT_VOLTAGE_DIVISION / 2;
 
 void setup();
 void sample(uint8_t *capture_buf);
-void generateFrequencies();
-void generateVoltages();
-int quantizeValue(float x, float *values);
-void quantizer(spi_inst_t *spi);
+size_t sample_adaptive(uint8_t *capture_buf, int adc_channel);
+uint32_t settle(int adc_channel);
+void print_settle_stats(int adc_channel);
+void quantizer(spi_inst_t *spi, uint32_t edge_us);
 void DAC_setup(void);
 void DAC_write(spi_inst_t *spi, float volt);
+uint16_t DAC_code(float volt);
+void DAC_write_code(spi_inst_t *spi, uint16_t value);
+void DAC_spi_write(spi_inst_t *spi, uint16_t value);
+bool install_tuning(const uint8_t *table, size_t len);
+void receive_tuning();
 void gpio_event_string(char *buf, uint32_t events);
-void gpio_callback(uint gpio, uint32_t events);
+void gate_irq_handler(void);
+void scale_poll(uint alarm_num);
+void gate_edge(uint gpio, uint32_t stamp, uint32_t now_us);
+event_t gate_take(event_t event);
+void gate_finish(event_t event);
+void handle_gate(event_t event);
+void print_gate_stats();
+void stress_start();
+void stress_edge(uint alarm_num);
+void stress_poll();
 void configure_scale();
 void print_bits16(uint16_t num);
 void print_uint8_array_bits(uint8_t *array, size_t size);
@@ -94,35 +278,98 @@ int main()
 
     sleep_ms(1000);
 
-    generateFrequencies();
-    generateVoltages();
+    generateFrequencies(FREQUENCIES);
+    generateVoltages(VOLTAGES);
 
+    // Gates on a raw handler, no per pin callback dispatch, ahead of everything else
     gpio_set_irq_enabled(GATE_PIN_A, GPIO_IRQ_EDGE_FALL, true);
     gpio_set_irq_enabled(GATE_PIN_B, GPIO_IRQ_EDGE_FALL, true);
-
-    gpio_set_irq_enabled(NOTE_PIN_01, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true);
-    gpio_set_irq_enabled(NOTE_PIN_02, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true);
-    gpio_set_irq_enabled(NOTE_PIN_03, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true);
-    gpio_set_irq_enabled(NOTE_PIN_04, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true);
-    gpio_set_irq_enabled(NOTE_PIN_05, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true);
-    gpio_set_irq_enabled(NOTE_PIN_06, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true);
-    gpio_set_irq_enabled(NOTE_PIN_07, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true);
-    gpio_set_irq_enabled(NOTE_PIN_08, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true);
-    gpio_set_irq_enabled(NOTE_PIN_09, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true);
-    gpio_set_irq_enabled(NOTE_PIN_10, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true);
-    gpio_set_irq_enabled(NOTE_PIN_11, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true);
-    gpio_set_irq_enabled(NOTE_PIN_12, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, true);
-    gpio_set_irq_callback(&gpio_callback);
+    gpio_add_raw_irq_handler_masked(GATE_PIN_MASK, gate_irq_handler);
+    irq_set_priority(IO_IRQ_BANK0, PICO_HIGHEST_IRQ_PRIORITY);
     irq_set_enabled(IO_IRQ_BANK0, true);
 
+    // Note switches polled at the lowest priority
+    scale_pins = gpio_get_all() & NOTE_PIN_MASK;
+    scale_pins_queued = true; // setup() has configured the scale for them
+    scale_poll_alarm = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(scale_poll_alarm, scale_poll);
+    irq_set_priority(hardware_alarm_get_irq_num(scale_poll_alarm), PICO_LOWEST_IRQ_PRIORITY);
+    hardware_alarm_set_target(scale_poll_alarm, make_timeout_time_us(SCALE_POLL_US));
+
+    uint32_t last_gate_us = time_us_32(); // For the recorder's idle sector erases
     while (true)
     {
-        sleep_ms(1);
+        event_t event;
+
+        // Scale changes first, all of them at once, so a gate queued behind them
+        // is quantized to the note pins as they are now
+        if (!event_queue_empty(&scale_events))
+        {
+            while (event_queue_pop(&scale_events, &event))
+                ;
+            configure_scale();
+            continue;
+        }
+        // Then gates, oldest first, checking for scale changes between each
+        if (event_queue_pop(&gate_events, &event))
+        {
+            event = gate_take(event);
+            handle_gate(event);
+            gate_finish(event);
+            last_gate_us = time_us_32();
+            continue;
+        }
+        stress_poll();
+        // Raw ADC stream start and stop (adc_stream.h), it has the ADC until stopped
+        bool streaming = adc_stream_poll();
+
+        int c = getchar_timeout_us(0);
+        if (c == TUNING_UPLOAD_CHAR)
+            receive_tuning();
+        else if (c == TUNING_RESET_CHAR)
+        {
+            tuning = NULL;
+            printf("tuning: 12-TET\n");
+        }
+        else if (c == GATE_STATS_CHAR)
+            print_gate_stats();
+        else if (c == GATE_STRESS_CHAR)
+            stress_start();
+#if RECORDER_ENABLED
+        else if (c == RECORDER_DUMP_CHAR)
+            recorder_dump();
+        else if (c == RECORDER_CLEAR_CHAR)
+            recorder_clear();
+#endif
+#if PROFILER_ENABLED
+        else if (c != PICO_ERROR_TIMEOUT)
+            profiler_command(c);
+#endif
+        else if (c == PICO_ERROR_TIMEOUT)
+        {
+#if RECORDER_ENABLED
+            // Full recorder blocks go to flash a page at a time between gates,
+            // not while streaming, the stream's DMA IRQ can't wait out the flash
+            if (!streaming && recorder_flush(time_us_32() - last_gate_us))
+                continue;
+#endif
+            // Nothing to do, sleep until an interrupt. The handlers also set the
+            // event flag, so an edge that lands just before this isn't slept through
+            __wfe();
+        }
     }
 }
 
 void setup()
 {
+#if CLK_SYS_KHZ
+    // Before anything takes its baud rate from clk_peri, which follows clk_sys
+#if CLK_SYS_KHZ > CLK_SYS_VREG_ABOVE_KHZ
+    vreg_set_voltage(VREG_VOLTAGE_1_15);
+    sleep_ms(10);
+#endif
+    set_sys_clock_khz(CLK_SYS_KHZ, true);
+#endif
     stdio_init_all();
 
     gpio_init(LED_PIN);
@@ -189,7 +436,7 @@ void setup()
 
     sleep_ms(1000);
     // Set up the DMA to start transferring data as soon as it appears in FIFO
-    uint dma_chan = dma_claim_unused_channel(true);
+    dma_chan = dma_claim_unused_channel(true);
     cfg = dma_channel_get_default_config(dma_chan);
 
     // Reading from constant address, writing to incrementing byte addresses
@@ -204,34 +451,246 @@ void setup()
     // DAC chip setup
     DAC_setup();
 
+#if QUANTIZER_TUNING_DEFAULT
+    install_tuning(tuning_default, sizeof(tuning_default));
+#endif
+
     // Startup check of selected scale notes
     configure_scale();
+
+#if PROFILER_ENABLED
+    profiler_init(HANDLER_BUDGET_US);
+#endif
+#if RECORDER_ENABLED
+    recorder_init();
+#endif
 }
 
-// Triggered on rising edge of GATE_PIN
-// Quantizes incoming CV on both inputs
-void gpio_callback(uint gpio, uint32_t events)
+// Triggered on falling edge of GATE_PIN_A/B
+// Only queues the edge, the main loop quantizes
+void QUANTIZE_HOT(gate_irq_handler)(void)
 {
-    // Put the GPIO event(s) that just happened into event_str
-    // so we can print it
-    // gpio_event_string(event_str, events);
-    // printf("GPIO %d %s\n", gpio, event_str);
+#if PROFILER_ENABLED
+    uint32_t stamp = profiler_now();
+#else
+    uint32_t stamp = 0;
+#endif
+    uint32_t now_us = time_us_32();
+
+    if (gpio_get_irq_event_mask(GATE_PIN_A) & GPIO_IRQ_EDGE_FALL)
+    {
+        gpio_acknowledge_irq(GATE_PIN_A, GPIO_IRQ_EDGE_FALL);
+        gate_edge(GATE_PIN_A, stamp, now_us);
+    }
+    if (gpio_get_irq_event_mask(GATE_PIN_B) & GPIO_IRQ_EDGE_FALL)
+    {
+        gpio_acknowledge_irq(GATE_PIN_B, GPIO_IRQ_EDGE_FALL);
+        gate_edge(GATE_PIN_B, stamp, now_us);
+    }
+    __sev();
+
+    PROFILE_END(PROF_STAGE_IRQ, stamp);
+}
 
-    if (gpio == GATE_PIN_A)
+// Every SCALE_POLL_US, at the lowest priority
+// Queues a note config change once the switches have held still for a poll
+void scale_poll(uint alarm_num)
+{
+    uint32_t pins = gpio_get_all() & NOTE_PIN_MASK;
+    if (pins != scale_pins)
     {
-        if (defined_scale != 0)
-            quantizer(SPI_A_PORT);
+        scale_pins = pins;
+        scale_pins_queued = false;
     }
-    if (gpio == GATE_PIN_B)
+    else if (!scale_pins_queued)
     {
-        if (defined_scale != 0)
-            quantizer(SPI_B_PORT);
+        event_t event = {0, 0, 0};
+        scale_pins_queued = event_queue_push(&scale_events, event);
+        __sev();
     }
+    hardware_alarm_set_target(alarm_num, make_timeout_time_us(SCALE_POLL_US));
+}
+
+// Queues an edge under GATE_POLICY, from gate_irq_handler() or stress_edge()
+// Both run at the highest priority, so they never preempt each other and the
+// queue still has a single producer
+void QUANTIZE_HOT(gate_edge)(uint gpio, uint32_t stamp, uint32_t now_us)
+{
+    gate_channel_t *channel = &gate_channels[gpio == GATE_PIN_A ? 0 : 1];
+    event_t event = {(uint8_t)gpio, stamp, now_us};
+
+    channel->edges++;
+    if (channel->pushed != __atomic_load_n(&channel->done, __ATOMIC_ACQUIRE))
+    {
+        channel->overruns++;
+#if GATE_POLICY == GATE_POLICY_DROP
+        channel->dropped++;
+        return;
+#elif GATE_POLICY == GATE_POLICY_LATEST
+        if (channel->pushed != __atomic_load_n(&channel->popped, __ATOMIC_ACQUIRE))
+        {
+            // Still queued, the main loop picks this up in its place
+            channel->latest = event;
+            __atomic_store_n(&channel->latest_seq, channel->latest_seq + 1, __ATOMIC_RELEASE);
+            channel->coalesced++;
+            return;
+        }
+#endif
+    }
+
+    if (event_queue_push(&gate_events, event))
+        __atomic_store_n(&channel->pushed, channel->pushed + 1, __ATOMIC_RELEASE);
+    else
+        channel->dropped++;
+}
 
-    if (gpio != GATE_PIN_A && gpio != GATE_PIN_B)
+// Takes a popped gate off its channel's queue count. Under GATE_POLICY_LATEST
+// returns the newest edge coalesced behind it instead, if there is one
+event_t gate_take(event_t event)
+{
+    gate_channel_t *channel = &gate_channels[event.gpio == GATE_PIN_A ? 0 : 1];
+    // From here on gate_edge() queues the next edge rather than coalescing it
+    __atomic_store_n(&channel->popped, channel->popped + 1, __ATOMIC_RELEASE);
+#if GATE_POLICY == GATE_POLICY_LATEST
+    uint32_t seq;
+    event_t latest;
+    do
+    {
+        // An edge can still land mid copy, once the next gate is queued behind this one
+        seq = __atomic_load_n(&channel->latest_seq, __ATOMIC_ACQUIRE);
+        latest = channel->latest;
+    } while (seq != __atomic_load_n(&channel->latest_seq, __ATOMIC_ACQUIRE));
+    if (seq != channel->latest_taken)
     {
-        // Note config change
-        configure_scale();
+        channel->latest_taken = seq;
+        return latest;
+    }
+#endif
+    return event;
+}
+
+// The gate is done with, later edges on the channel are no longer overruns
+void gate_finish(event_t event)
+{
+    gate_channel_t *channel = &gate_channels[event.gpio == GATE_PIN_A ? 0 : 1];
+    __atomic_store_n(&channel->done, channel->done + 1, __ATOMIC_RELEASE);
+}
+
+// Quantizes incoming CV on the input of the gate that fired
+void QUANTIZE_HOT(handle_gate)(event_t event)
+{
+    PROFILE_END_US(PROF_STAGE_QUEUE, event.time_us);
+    PROFILE_GATE_EDGE(event.time_us);
+    PROFILE_HANDLER_ENTER();
+
+    // While the ADC streams to USB the outputs hold
+    if (defined_scale != 0 && !adc_stream_active())
+        quantizer(event.gpio == GATE_PIN_A ? SPI_A_PORT : SPI_B_PORT, event.time_us);
+
+    PROFILE_HANDLER_EXIT();
+}
+
+void print_gate_stats()
+{
+    static const char *policies[] = {"drop", "latest", "queue"};
+    printf("Gate policy %s, queue drops %u\n", policies[GATE_POLICY], gate_events.dropped);
+    for (int i = 0; i < 2; i++)
+    {
+        gate_channel_t *channel = &gate_channels[i];
+        printf("Gate %c: %u edges, %u quantized, %u overruns, %u dropped, %u coalesced\n",
+               'A' + i, channel->edges, channel->done, channel->overruns, channel->dropped, channel->coalesced);
+    }
+}
+
+static void stress_step()
+{
+    stress.start = gate_channels[stress.channel];
+    stress.period_us = 1000000 / stress_rates_hz[stress.step];
+    stress.edges_left = stress_rates_hz[stress.step] * STRESS_STEP_MS / 1000;
+    stress.step_done = false;
+    stress.next_us = time_us_64() + stress.period_us;
+    hardware_alarm_set_target(stress_alarm, from_us_since_boot(stress.next_us));
+}
+
+void stress_start()
+{
+    if (stress.channel >= 0)
+        return;
+    if (stress_alarm < 0)
+    {
+        stress_alarm = hardware_alarm_claim_unused(true);
+        hardware_alarm_set_callback(stress_alarm, stress_edge);
+        irq_set_priority(hardware_alarm_get_irq_num(stress_alarm), PICO_HIGHEST_IRQ_PRIORITY);
+    }
+    printf("Gate stress test, %ums per rate\n", STRESS_STEP_MS);
+    stress.channel = 0;
+    stress.step = 0;
+    stress.max_hz[0] = stress.max_hz[1] = 0;
+    stress_step();
+}
+
+// One injected edge, every stress.period_us
+void QUANTIZE_HOT(stress_edge)(uint alarm_num)
+{
+#if PROFILER_ENABLED
+    uint32_t stamp = profiler_now();
+#else
+    uint32_t stamp = 0;
+#endif
+    gate_edge(stress.channel ? GATE_PIN_B : GATE_PIN_A, stamp, time_us_32());
+    __sev();
+
+    if (--stress.edges_left == 0)
+    {
+        stress.step_done = true;
+        return;
+    }
+    stress.next_us += stress.period_us;
+    // Late already, so no alarm would fire, take it now
+    if (hardware_alarm_set_target(alarm_num, from_us_since_boot(stress.next_us)))
+        hardware_alarm_force_irq(alarm_num);
+}
+
+// From the main loop, reports each rate once its last gate has been quantized
+// and moves on to the next
+void stress_poll()
+{
+    if (stress.channel < 0 || !stress.step_done)
+        return;
+    gate_channel_t *channel = &gate_channels[stress.channel];
+    if (__atomic_load_n(&channel->pushed, __ATOMIC_ACQUIRE) != channel->done)
+        return;
+
+    uint32_t overruns = channel->overruns - stress.start.overruns;
+    printf("Stress gate %c %uHz: %u edges, %u quantized, %u overruns, %u dropped, %u coalesced\n",
+           'A' + stress.channel, stress_rates_hz[stress.step], channel->edges - stress.start.edges,
+           channel->done - stress.start.done, overruns, channel->dropped - stress.start.dropped,
+           channel->coalesced - stress.start.coalesced);
+
+    if (overruns == 0)
+    {
+        stress.max_hz[stress.channel] = stress_rates_hz[stress.step];
+        if (++stress.step < STRESS_STEPS)
+        {
+            stress_step();
+            return;
+        }
+    }
+    if (stress.channel == 0)
+    {
+        stress.channel = 1;
+        stress.step = 0;
+        stress_step();
+        return;
+    }
+
+    stress.channel = -1;
+    for (int i = 0; i < 2; i++)
+    {
+        if (stress.max_hz[i])
+            printf("Stress gate %c: sustains %uHz\n", 'A' + i, stress.max_hz[i]);
+        else
+            printf("Stress gate %c: overruns even at %uHz\n", 'A' + i, stress_rates_hz[0]);
     }
 }
 
@@ -253,13 +712,63 @@ void configure_scale()
     defined_scale = defined_scale ^ ((gpio_get(NOTE_PIN_11) ? 0 : 1) << 10);
     defined_scale = defined_scale ^ ((gpio_get(NOTE_PIN_12) ? 0 : 1) << 11);
 
+    snap_table_build(&snap_table, defined_scale);
+    if (tuning)
+        tuning_apply_scale(tuning, defined_scale, tuning_volts_per_step);
+
     printf("Configured scale: ");
     print_bits16(defined_scale);
     printf("\n");
 }
 
+// Loads a table into the spare lookup and switches the gates over to it
+bool install_tuning(const uint8_t *table, size_t len)
+{
+    tuning_t *next = tuning == &tunings[0] ? &tunings[1] : &tunings[0];
+    int err = tuning_load(next, table, len, (uint16_t)(SPI_VMAX * 1000), DAC_MAX_CODE);
+    if (err)
+    {
+        printf("tuning: %s table\n", err == -2 ? "wrong DAC range in" : "malformed");
+        return false;
+    }
+
+    tuning_apply_scale(next, defined_scale, tuning_volts_per_step);
+    tuning = next;
+
+    printf("tuning: %u notes, %u per period\n", next->num_notes, next->degrees);
+    return true;
+}
+
+// Reads a table sent after TUNING_UPLOAD_CHAR, its header gives the length
+void receive_tuning()
+{
+    static uint8_t table[TUNING_HEADER_SIZE + TUNING_MAX_NOTES * TUNING_NOTE_SIZE];
+    size_t len = TUNING_HEADER_SIZE;
+    for (size_t i = 0; i < len; i++)
+    {
+        int c = getchar_timeout_us(TUNING_UPLOAD_TIMEOUT_US);
+        if (c == PICO_ERROR_TIMEOUT)
+        {
+            printf("tuning: upload timed out\n");
+            return;
+        }
+        table[i] = (uint8_t)c;
+
+        if (i == TUNING_HEADER_SIZE - 1)
+        {
+            len = tuning_table_size(table);
+            if (len == 0 || len > sizeof(table))
+            {
+                printf("tuning: malformed table\n");
+                return;
+            }
+        }
+    }
+    install_tuning(table, len);
+}
+
 // free-running sample
-void sample(uint8_t *capture_buf, int adc_channel)
+void QUANTIZE_HOT(sample)(uint8_t *capture_buf, int adc_channel)
 {
     adc_select_input(adc_channel);
 
@@ -280,6 +789,53 @@ void sample(uint8_t *capture_buf, int adc_channel)
     gpio_put(LED_PIN, 0);
 }
 
+// free-running sample that stops early once the burst estimate is stable
+// Returns the number of samples captured into capture_buf
+size_t QUANTIZE_HOT(sample_adaptive)(uint8_t *capture_buf, int adc_channel)
+{
+    adc_select_input(adc_channel);
+
+    adc_fifo_drain();
+    adc_run(false);
+
+    dma_channel_configure(dma_chan, &cfg,
+                          capture_buf,   // dst
+                          &adc_hw->fifo, // src
+                          NSAMP,         // transfer count
+                          true           // start immediately
+    );
+
+    gpio_put(LED_PIN, 1);
+    adc_run(true);
+
+    // Running mean and variance of the samples (Welford), updated as DMA lands them
+    size_t n = 0;
+    float mean = 0.0f;
+    float m2 = 0.0f;
+    while (n < NSAMP)
+    {
+        size_t landed = NSAMP - dma_channel_hw_addr(dma_chan)->transfer_count;
+        if (landed == n)
+            continue;
+
+        for (; n < landed; n++)
+        {
+            float delta = capture_buf[n] - mean;
+            mean += delta / (n + 1);
+            m2 += delta * (capture_buf[n] - mean);
+        }
+
+        if (n >= BURST_MIN_SAMP && m2 / (n - 1) / n < BURST_VARIANCE_THRESHOLD)
+            break;
+    }
+
+    adc_run(false);
+    dma_channel_abort(dma_chan);
+    gpio_put(LED_PIN, 0);
+
+    return n;
+}
+
 // Sample using adc_read
 float sample_single(int adc_channel)
 {
@@ -295,7 +851,7 @@ float sample_single(int adc_channel)
         sum += result;
     }
     float avg = (float)sum / NSAMP;
-    float adc_voltage = avg / INPUT_VOLTAGE_DIVISION * conversion_factor;
+    float adc_voltage = avg * adc_volts_per_count;
 
     // adc_read();
     // uint16_t result = adc_read();
@@ -304,112 +860,161 @@ float sample_single(int adc_channel)
     return adc_voltage;
 }
 
-void generateFrequencies()
+// Samples ADC and writes to DAC
+void QUANTIZE_HOT(quantizer)(spi_inst_t *spi, uint32_t edge_us)
 {
-    float freq = (float)FREQ_0V;
+    float adc_voltage = 0.0f;     // Average value of samples
+    float desired_voltage = 0.0f; // Quantized voltage
 
-    for (int i = 0; i < NUM_PIANO_KEYS; i++)
-    {
-        freq = FREQ_0V * pow(pow(2, VOLT_PER_SEMITONE), i);
-        FREQUENCIES[i] = roundf(freq * 1000) / 1000;
-    }
-}
+    int cap_channel = spi == SPI_A_PORT ? ADC_CAPTURE_CHANNEL_1 : ADC_CAPTURE_CHANNEL_2;
 
-void generateVoltages()
-{
-    int minVolt = 0;
-    int maxVolt = 10;
+    // adc_voltage = sample_single(cap_channel);
+    PROFILE_BEGIN(t_settle);
+#if SETTLE_ADAPTIVE
+    settle(cap_channel); // wait until the CV stops moving
+#else
+    sleep_ms(SETTLE_FIXED_MS); // sleep a little to let the CV stabilize
+#endif
+    PROFILE_END(PROF_STAGE_SETTLE, t_settle);
+
+    PROFILE_BEGIN(t_capture);
+#if BURST_ADAPTIVE
+    size_t n = sample_adaptive(cap_buf, cap_channel);
+#else
+    sample(cap_buf, cap_channel);
+    size_t n = NSAMP;
+#endif
+    PROFILE_END(PROF_STAGE_CAPTURE, t_capture);
+
+    PROFILE_BEGIN(t_filter);
+    float avg = estimate_burst(cap_buf, n);
+    PROFILE_END(PROF_STAGE_FILTER, t_filter);
+
+    PROFILE_BEGIN(t_quantize);
+    adc_voltage = avg * adc_volts_per_count;
+    const tuning_t *active_tuning = tuning;
+    int quantized_idx;
+    if (active_tuning)
+        quantized_idx = tuning_quantize(active_tuning, avg * 2);
+    else
+        quantized_idx = snap_note(&snap_table, quantizeValue(adc_voltage, VOLTAGES));
+    PROFILE_END(PROF_STAGE_QUANTIZE, t_quantize);
 
-    for (int i = 0; i < NUM_PIANO_KEYS; i++)
+    if (quantized_idx < 0)
     {
-        float volt = VOLT_PER_SEMITONE * i;
-        VOLTAGES[i] = volt;
+        // Trying to output a voltage below 0, which means we've reached the end of the range, and should keep outputting the previous voltage
+#if RECORDER_ENABLED
+        recorder_gate(spi == SPI_A_PORT ? 0 : 1, edge_us, cap_buf, n, defined_scale, active_tuning != NULL, -1);
+#endif
+        return;
     }
-}
 
-// Returns the index of the value closest to x in values ("rounded" down)
-int quantizeValue(float x, float *values)
-{
-    int n = NUM_PIANO_KEYS;
-    int l = 0;     // lower limit
-    int u = n - 1; // upper limit
-
-    if (x <= values[0])
-        return values[0];
-    else if (x >= values[u])
-        return values[u];
+    // printf("Scale note check %u ", scale_note);
+    // print_bits16(1 << scale_note);
+    // printf(" ");
+    // print_bits16((1 << scale_note) & defined_scale);
+    // printf("\n");
 
-    while (u - l > 1)
+    float frequency;
+    uint16_t code;
+    PROFILE_BEGIN(t_dac);
+    if (active_tuning)
     {
-        int midPoint = (u + l) >> 1;
-        if (x == values[midPoint])
-            return values[midPoint];
-        else if (x > values[midPoint])
-            l = midPoint;
-        else
-            u = midPoint;
+        // Straight to the DAC code the table was compiled with
+        code = active_tuning->notes[quantized_idx].dac_code;
+        DAC_write_code(spi, code);
+        desired_voltage = code * SPI_VMAX / DAC_MAX_CODE;
+        frequency = FREQ_0V * exp2f(desired_voltage);
+    }
+    else
+    {
+        desired_voltage = MIN(SPI_VMAX, VOLTAGES[quantized_idx]);
+        code = DAC_code(desired_voltage);
+        DAC_write(spi, desired_voltage);
+        frequency = FREQUENCIES[quantized_idx];
     }
+    PROFILE_END(PROF_STAGE_DAC, t_dac);
 
-    return l;
+#if RECORDER_ENABLED
+    recorder_gate(spi == SPI_A_PORT ? 0 : 1, edge_us, cap_buf, n, defined_scale, active_tuning != NULL, code);
+#endif
+
+    printf("Sampled voltage (%u samples): %0.4fV Quantized => %0.4fV, %0.1fHz, idx %0u \n", (uint)n, adc_voltage, desired_voltage, frequency, quantized_idx);
+#if SETTLE_ADAPTIVE
+    print_settle_stats(cap_channel);
+#endif
 }
 
-// Samples ADC and writes to DAC
-void quantizer(spi_inst_t *spi)
+// Reads the CV every SETTLE_INTERVAL_US until it has been flat for SETTLE_STABLE_COUNT
+// intervals in a row, or SETTLE_TIMEOUT_US has passed
+// Returns the time spent settling in us
+uint32_t QUANTIZE_HOT(settle)(int adc_channel)
 {
-    float adc_voltage = 0.0f;     // Average value of samples
-    float desired_voltage = 0.0f; // Quantized voltage
+    adc_select_input(adc_channel);
+    adc_run(false);
 
-    int cap_channel = spi == SPI_A_PORT ? ADC_CAPTURE_CHANNEL_1 : ADC_CAPTURE_CHANNEL_2;
+    uint32_t start = time_us_32();
+    uint32_t elapsed = 0;
+    int previous = -1;
+    int stable = 0;
+    bool timed_out = false;
 
-    // adc_voltage = sample_single(cap_channel);
-    sleep_ms(10); // sleep a little to let the CV stabilize
-    sample(cap_buf, cap_channel);
-    uint64_t sum = 0;
-    for (int i = 0; i < NSAMP; i++)
+    while (true)
     {
-        sum += cap_buf[i];
-    }
-    float avg = (float)sum / NSAMP;
-    adc_voltage = avg / INPUT_VOLTAGE_DIVISION * conversion_factor;
-    int quantized_idx = quantizeValue(adc_voltage, VOLTAGES);
-    int scale_note = quantized_idx % 12;
-    uint16_t note_mask = 1 << scale_note;
+        uint32_t reading_start = time_us_32();
+        int reading = 0;
+        for (int i = 0; i < SETTLE_READ_AVG; i++)
+        {
+            reading += adc_read();
+        }
+        reading /= SETTLE_READ_AVG;
 
-    if ((note_mask & defined_scale) != note_mask && quantized_idx != 0)
-    {
-        size_t starting_point = quantized_idx;
-        quantized_idx = -1;
-        // From the current note, step down chromatically, up to an octave, and find the next turned on note
-        for (size_t i = starting_point; i >= starting_point - 12; i--)
+        elapsed = time_us_32() - start;
+        if (previous >= 0 && abs(reading - previous) <= SETTLE_SLOPE_THRESHOLD)
+            stable++;
+        else
+            stable = 0;
+        previous = reading;
+
+        if (stable >= SETTLE_STABLE_COUNT)
+            break;
+        if (elapsed >= SETTLE_TIMEOUT_US)
         {
-            note_mask = 1 << (i % 12); // Bit shift to mask the correct note according to defined_scale, wraps around to 12 at 0
-            if ((note_mask & defined_scale) == note_mask)
-            {
-                quantized_idx = i;
-                printf("Floored index %0u to %0u\n", starting_point, quantized_idx);
-                break;
-            }
+            timed_out = true;
+            break;
         }
+
+        while (time_us_32() - reading_start < SETTLE_INTERVAL_US)
+            tight_loop_contents();
     }
 
-    if (quantized_idx < 0)
-        // Trying to output a voltage below 0, which means we've reached the end of the range, and should keep outputting the previous voltage
-        return;
+    settle_stats_t *stats = &settle_stats[adc_channel];
+    stats->count++;
+    stats->timeouts += timed_out;
+    stats->last_us = elapsed;
+    stats->min_us = MIN(stats->min_us, elapsed);
+    stats->max_us = MAX(stats->max_us, elapsed);
+    stats->total_us += elapsed;
 
-    // printf("Scale note check %u ", scale_note);
-    // print_bits16(1 << scale_note);
-    // printf(" ");
-    // print_bits16((1 << scale_note) & defined_scale);
-    // printf("\n");
+    return elapsed;
+}
 
-    desired_voltage = MIN(SPI_VMAX, VOLTAGES[quantized_idx]);
-    printf("Sampled voltage (avg): %0.4fV Quantized => %0.4fV, %0.1fHz, idx %0u \n", adc_voltage, desired_voltage, FREQUENCIES[quantized_idx], quantized_idx);
-    DAC_write(spi, desired_voltage);
+void print_settle_stats(int adc_channel)
+{
+    settle_stats_t *stats = &settle_stats[adc_channel];
+    printf("Settled ch%d in %uus (min %uus, avg %uus, max %uus, %u timeouts over %u gates)\n",
+           adc_channel, stats->last_us, stats->min_us, (uint)(stats->total_us / stats->count),
+           stats->max_us, stats->timeouts, stats->count);
 }
 
 // Initializes 4911 DAC
 void DAC_setup(void)
 {
+#if OUTPUT_ENGINE & OUTPUT_SD
+    if (!sd_out_init(0, OUT_A_SD_PIN) || !sd_out_init(1, OUT_B_SD_PIN))
+        printf("Sigma-delta outputs: no free state machine or DMA channel\n");
+#endif
+#if OUTPUT_ENGINE & OUTPUT_DAC
     int spi_speed = 500000; // 500kHz
 
     // SPI A
@@ -437,20 +1042,44 @@ void DAC_setup(void)
     gpio_init(OUT_B_LDAC);
     gpio_set_dir(OUT_B_LDAC, GPIO_OUT);
     gpio_put(OUT_B_LDAC, 1);
+#endif
+}
+
+// To whichever outputs OUTPUT_ENGINE has, the sigma-delta engine at its full resolution
+void QUANTIZE_HOT(DAC_write)(spi_inst_t *spi, float volt)
+{
+#if OUTPUT_ENGINE & OUTPUT_DAC
+    DAC_spi_write(spi, DAC_code(volt));
+#endif
+#if OUTPUT_ENGINE & OUTPUT_SD
+    sd_out_set_volts(spi == SPI_A_PORT ? 0 : 1, MIN(volt, SPI_VMAX));
+#endif
 }
 
-void DAC_write(spi_inst_t *spi, float volt)
+uint16_t QUANTIZE_HOT(DAC_code)(float volt)
 {
     float _volt = MIN(volt, SPI_VMAX);
+    float volt_per_bit = SPI_VMAX / DAC_MAX_CODE;
+    return (int)floorf(_volt / volt_per_bit);
+}
+
+// A DAC code, as the tuning tables give. The sigma-delta engine gets the voltage it stands for
+void QUANTIZE_HOT(DAC_write_code)(spi_inst_t *spi, uint16_t value)
+{
+#if OUTPUT_ENGINE & OUTPUT_DAC
+    DAC_spi_write(spi, value);
+#endif
+#if OUTPUT_ENGINE & OUTPUT_SD
+    sd_out_set_volts(spi == SPI_A_PORT ? 0 : 1, value * SPI_VMAX / DAC_MAX_CODE);
+#endif
+}
+
+void QUANTIZE_HOT(DAC_spi_write)(spi_inst_t *spi, uint16_t value)
+{
     uint8_t data[2];
-    float volt_per_bit = SPI_VMAX / 1023.0;
-    uint16_t value = (int)floor(_volt / volt_per_bit);
     data[0] = (0b0111'0000 & 0xF0) | ((value >> 6) & 0x0F);
     data[1] = (uint8_t)((value & 0xFF) << 2);
 
-    printf("Writing %0.u to SPI%0u: ", value, spi == SPI_A_PORT ? 0 : 1);
-    print_uint8_array_bits(data, 2);
-
     if (spi == SPI_A_PORT)
     {
         gpio_put(OUT_A_CS, 0);
@@ -467,6 +1096,11 @@ void DAC_write(spi_inst_t *spi, float volt)
         gpio_put(OUT_B_LDAC, 0);
         gpio_put(OUT_B_LDAC, 1);
     }
+
+#if DAC_PRINT_WRITES
+    printf("Writing %0.u to SPI%0u: ", value, spi == SPI_A_PORT ? 0 : 1);
+    print_uint8_array_bits(data, 2);
+#endif
 }
 
 static const char *gpio_irq_str[] = {
@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "recorder.h"
+
+#define RECORDER_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - RECORDER_FLASH_SECTORS * RECORDER_BLOCK_SIZE)
+
+#if RECORDER_BLOCK_SIZE != FLASH_SECTOR_SIZE
+#error "A recorder block is one flash sector"
+#endif
+
+extern char __flash_binary_end;
+
+static uint8_t __aligned(4) blocks[RECORDER_RAM_BLOCKS][RECORDER_BLOCK_SIZE];
+static uint32_t ram_head;    // Block being written, counting up, wrapped into blocks[]
+static uint32_t ram_tail;    // Oldest block not in flash yet
+static bool block_open;      // blocks[ram_head] has been started
+static uint32_t flash_next;  // Sector the next block goes to, the oldest one in the ring
+static uint32_t next_seq;
+static uint32_t lost_blocks; // Dropped from RAM before the flash caught up
+static bool ready;
+
+// Flash work is spread over recorder_flush() calls, one operation each
+static bool sector_erased;  // flash_next is erased and ready for a block
+static uint32_t flush_page; // Pages of blocks[ram_tail] programmed into it so far
+static uint32_t clear_next = RECORDER_FLASH_SECTORS; // Next sector recorder_clear() has to erase
+
+static uint32_t last_us;
+static uint16_t last_scale;
+static uint16_t last_code[2];
+
+static recorder_block_t *block_header(uint32_t block)
+{
+    return (recorder_block_t *)blocks[block % RECORDER_RAM_BLOCKS];
+}
+
+static const recorder_block_t *flash_header(uint32_t sector)
+{
+    return (const recorder_block_t *)(uintptr_t)(XIP_BASE + RECORDER_FLASH_OFFSET + sector * RECORDER_BLOCK_SIZE);
+}
+
+static uint8_t *put_varint(uint8_t *p, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+static uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+bool recorder_init(void)
+{
+    if ((uintptr_t)&__flash_binary_end > XIP_BASE + RECORDER_FLASH_OFFSET)
+    {
+        printf("recorder: program overlaps the flash ring, disabled\n");
+        return false;
+    }
+
+    // Carry on after the newest block already in flash
+    bool found = false;
+    for (uint32_t i = 0; i < RECORDER_FLASH_SECTORS; i++)
+    {
+        const recorder_block_t *block = flash_header(i);
+        if (block->magic != RECORDER_MAGIC)
+            continue;
+        if (!found || (int32_t)(block->seq - next_seq) >= 0)
+        {
+            next_seq = block->seq + 1;
+            flash_next = (i + 1) % RECORDER_FLASH_SECTORS;
+            found = true;
+        }
+    }
+    ready = true;
+    return true;
+}
+
+// Closes the open block, if any, and starts the next one at now_us
+static void open_block(uint32_t now_us)
+{
+    if (block_open)
+        ram_head++;
+    if (ram_head - ram_tail >= RECORDER_RAM_BLOCKS)
+    {
+        // The flash fell behind, the oldest block goes. If it was part way into
+        // its sector, the sector has to be erased again for the next one
+        ram_tail++;
+        lost_blocks++;
+        if (flush_page)
+        {
+            flush_page = 0;
+            sector_erased = false;
+        }
+    }
+
+    memset(blocks[ram_head % RECORDER_RAM_BLOCKS], 0, RECORDER_BLOCK_SIZE);
+    recorder_block_t *header = block_header(ram_head);
+    header->magic = RECORDER_MAGIC;
+    header->seq = next_seq++;
+    header->start_us = now_us;
+    header->scale = last_scale;
+    header->code[0] = last_code[0];
+    header->code[1] = last_code[1];
+    header->version = RECORDER_VERSION;
+    block_open = true;
+    last_us = now_us;
+}
+
+void recorder_gate(int channel, uint32_t edge_us, const uint8_t *burst, size_t n, uint16_t scale, bool tuning, int code)
+{
+    if (!ready)
+        return;
+    if (n > 255)
+        n = 255;
+
+    // Worst case: tag, varint, scale, n, first sample, 3 nibbles a sample, code varint
+    size_t worst = 1 + 5 + 2 + 1 + 1 + (3 * n + 1) / 2 + 3;
+    if (!block_open || sizeof(recorder_block_t) + block_header(ram_head)->used + worst > RECORDER_BLOCK_SIZE)
+        open_block(edge_us);
+
+    recorder_block_t *header = block_header(ram_head);
+    uint8_t *start = blocks[ram_head % RECORDER_RAM_BLOCKS] + sizeof(recorder_block_t) + header->used;
+    uint8_t *p = start;
+
+    uint8_t tag = channel ? RECORD_CHANNEL : 0;
+    if (scale != last_scale)
+        tag |= RECORD_SCALE;
+    if (code < 0)
+        tag |= RECORD_HELD;
+    if (tuning)
+        tag |= RECORD_TUNING;
+    *p++ = tag;
+    p = put_varint(p, edge_us - last_us);
+    if (tag & RECORD_SCALE)
+    {
+        *p++ = (uint8_t)scale;
+        *p++ = (uint8_t)(scale >> 8);
+    }
+
+    *p++ = (uint8_t)n;
+    if (n > 0)
+    {
+        *p++ = burst[0];
+        // Sample deltas a nibble each, a settled CV moves by a count or two
+        uint8_t nibbles[3];
+        int pending = -1; // High nibble waiting for its low one
+        for (size_t i = 1; i < n; i++)
+        {
+            uint32_t delta = zigzag(burst[i] - burst[i - 1]);
+            int count = 1;
+            nibbles[0] = (uint8_t)delta;
+            if (delta >= RECORD_ESCAPE)
+            {
+                nibbles[0] = RECORD_ESCAPE;
+                nibbles[1] = burst[i] >> 4;
+                nibbles[2] = burst[i] & 0x0F;
+                count = 3;
+            }
+            for (int j = 0; j < count; j++)
+            {
+                if (pending < 0)
+                    pending = nibbles[j];
+                else
+                {
+                    *p++ = (uint8_t)(pending << 4 | nibbles[j]);
+                    pending = -1;
+                }
+            }
+        }
+        if (pending >= 0)
+            *p++ = (uint8_t)(pending << 4);
+    }
+
+    if (code >= 0)
+    {
+        p = put_varint(p, zigzag(code - last_code[channel]));
+        last_code[channel] = (uint16_t)code;
+    }
+
+    header->used += (uint16_t)(p - start);
+    last_us = edge_us;
+    last_scale = scale;
+}
+
+// Interrupts are off while the flash is out of XIP, the gate IRQ included
+static void erase_sector(uint32_t sector)
+{
+    uint32_t irq_state = save_and_disable_interrupts();
+    flash_range_erase(RECORDER_FLASH_OFFSET + sector * RECORDER_BLOCK_SIZE, RECORDER_BLOCK_SIZE);
+    restore_interrupts(irq_state);
+}
+
+bool recorder_flush(uint32_t idle_us)
+{
+    if (!ready)
+        return false;
+    bool may_erase = idle_us >= RECORDER_ERASE_IDLE_US;
+
+    if (clear_next < RECORDER_FLASH_SECTORS)
+    {
+        if (!may_erase)
+            return false;
+        erase_sector(clear_next++);
+        if (clear_next == RECORDER_FLASH_SECTORS)
+        {
+            flash_next = 0;
+            sector_erased = true;
+            printf("recorder: cleared\n");
+        }
+        return true;
+    }
+
+    // The next sector is erased ahead, while nothing is going on, even before
+    // there is a block for it
+    if (!sector_erased)
+    {
+        if (!may_erase)
+            return false;
+        erase_sector(flash_next);
+        sector_erased = true;
+        return true;
+    }
+    if (ram_tail == ram_head)
+        return false;
+
+    // One page a call, only as many as the records reach. The header page goes
+    // last, so a block cut short by a reset has no magic and is skipped
+    const recorder_block_t *header = block_header(ram_tail);
+    uint32_t pages = (sizeof(recorder_block_t) + header->used + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE;
+    uint32_t page = flush_page + 1 < pages ? flush_page + 1 : 0;
+    uint32_t offset = RECORDER_FLASH_OFFSET + flash_next * RECORDER_BLOCK_SIZE + page * FLASH_PAGE_SIZE;
+    uint32_t irq_state = save_and_disable_interrupts();
+    flash_range_program(offset, blocks[ram_tail % RECORDER_RAM_BLOCKS] + page * FLASH_PAGE_SIZE, FLASH_PAGE_SIZE);
+    restore_interrupts(irq_state);
+
+    if (++flush_page == pages)
+    {
+        flush_page = 0;
+        sector_erased = false;
+        ram_tail++;
+        flash_next = (flash_next + 1) % RECORDER_FLASH_SECTORS;
+    }
+    return true;
+}
+
+static void put_raw(const void *data, size_t len)
+{
+    // putchar_raw() skips the \n to \r\n translation
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < len; i++)
+    {
+        putchar_raw(bytes[i]);
+    }
+}
+
+void recorder_dump(void)
+{
+    uint32_t ram_end = ram_head + (block_open ? 1 : 0);
+    uint32_t count = ram_end - ram_tail;
+    for (uint32_t i = 0; i < RECORDER_FLASH_SECTORS; i++)
+    {
+        count += flash_header(i)->magic == RECORDER_MAGIC;
+    }
+
+    stdio_flush();
+    uint16_t format[2] = {RECORDER_VERSION, RECORDER_BLOCK_SIZE};
+    put_raw(RECORDER_DUMP_MAGIC, 4);
+    put_raw(format, sizeof(format));
+    put_raw(&count, sizeof(count));
+    put_raw(&lost_blocks, sizeof(lost_blocks));
+
+    // The flash ring from its oldest sector round, then what is still in RAM
+    for (uint32_t i = 0; i < RECORDER_FLASH_SECTORS; i++)
+    {
+        const recorder_block_t *block = flash_header((flash_next + i) % RECORDER_FLASH_SECTORS);
+        if (block->magic == RECORDER_MAGIC)
+            put_raw(block, RECORDER_BLOCK_SIZE);
+    }
+    for (uint32_t block = ram_tail; block != ram_end; block++)
+    {
+        put_raw(blocks[block % RECORDER_RAM_BLOCKS], RECORDER_BLOCK_SIZE);
+    }
+    stdio_flush();
+}
+
+void recorder_clear(void)
+{
+    if (!ready)
+        return;
+
+    // What is in RAM goes now, the sectors are erased by recorder_flush() a
+    // call at a time
+    ram_tail = ram_head + (block_open ? 1 : 0);
+    ram_head = ram_tail;
+    block_open = false;
+    lost_blocks = 0;
+    flush_page = 0;
+    sector_erased = false;
+    clear_next = 0;
+    printf("recorder: clearing\n");
+}
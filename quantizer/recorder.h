@@ -0,0 +1,89 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ Gate recorder for post-mortem analysis of "wrong note" reports. Every gate is
+ appended to a block in RAM: its time, the raw ADC burst, the scale and the DAC
+ code written. Full blocks are copied to a ring of sectors at the top of flash
+ from the main loop a flash page at a time while it is idle, sectors erased only
+ after a second without gates, and 'd' over USB dumps flash and RAM.
+ host/python/replay_recording.py decodes a dump and runs it back through the
+ quantizer code.
+
+ Blocks are one flash sector each and start with a recorder_block_t, so every
+ block decodes on its own. Records follow, each:
+     u8      tag, RECORD_ bits below
+     varint  us since the previous record, or since the block's start_us
+     u16     scale, only with RECORD_SCALE
+     u8      burst length n
+     u8      first sample, when n > 0
+     nibbles n - 1 sample deltas, zigzag coded, RECORD_ESCAPE followed by the raw
+             sample in two more nibbles (high first), padded to a whole byte
+     varint  DAC code minus the channel's previous code, zigzag coded, not with RECORD_HELD
+ Multi byte fields are little endian, varints 7 bits a byte, low first.
+*/
+
+// Set to 0 to compile the recorder out
+#define RECORDER_ENABLED 1
+
+#define RECORDER_BLOCK_SIZE 4096   // FLASH_SECTOR_SIZE
+#ifndef RECORDER_RAM_BLOCKS
+#define RECORDER_RAM_BLOCKS 4      // Blocks held in RAM waiting for the flash, set per board in CMakeLists.txt
+#endif
+#define RECORDER_FLASH_SECTORS 64  // Flash ring at the top of flash, 256K
+#define RECORDER_ERASE_IDLE_US 1000000 // Sectors are only erased this long after the last gate
+#define RECORDER_MAGIC 0x42525150  // "PQRB"
+#define RECORDER_DUMP_MAGIC "PQRD"
+#define RECORDER_VERSION 1
+
+#define RECORD_CHANNEL 0x01 // Gate B, else gate A
+#define RECORD_SCALE 0x02   // The scale changed since the last record, and follows
+#define RECORD_HELD 0x04    // No note in range, the previous output was kept
+#define RECORD_TUNING 0x08  // Quantized through a tuning table rather than 12-TET
+#define RECORD_ESCAPE 15
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t seq;       // Blocks are numbered from 0 in the order they were started
+    uint32_t start_us;  // time_us_32() the first record's delta is from
+    uint16_t used;      // Bytes of records after the header
+    uint16_t scale;     // Scale at the start of the block
+    uint16_t code[2];   // Last DAC code of each channel before the block
+    uint16_t version;
+    uint16_t reserved;
+} recorder_block_t;
+
+// Finds where the flash ring left off. Returns false, and records nothing, when
+// the program reaches into the flash the ring would use
+bool recorder_init(void);
+
+// One gate. code is the DAC code written, or -1 when the output was held
+void recorder_gate(int channel, uint32_t edge_us, const uint8_t *burst, size_t n, uint16_t scale, bool tuning, int code);
+
+/*
+ Moves full blocks to flash a step at a time, for the main loop with no gate
+ queued. idle_us is the time since the last gate. Interrupts, the gates' too,
+ are off for the one flash operation each call does at most:
+ - programming a 256 byte page, 0.4ms typical and 3ms at worst on the Pico's
+   W25Q16JV, for a block's pages one call each
+ - erasing a sector, 45ms typical and 400ms at worst, only once idle_us has
+   reached RECORDER_ERASE_IDLE_US. The next sector is erased ahead of its block,
+   and recorder_clear()'s one a call
+ Returns true if it did either
+*/
+bool recorder_flush(uint32_t idle_us);
+
+// Every block in flash and RAM, oldest first, as raw binary on stdio after a
+// header: "PQRD", u16 version, u16 block size, u32 blocks, u32 blocks lost
+void recorder_dump(void);
+
+// Drops what is in RAM and starts again. The flash ring is erased by the
+// recorder_flush() calls that follow, until "recorder: cleared"
+void recorder_clear(void);
+
+#endif
@@ -0,0 +1,145 @@
+#include "sd_out.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "sd_out.pio.h"
+
+#if SD_OUT_RING & (SD_OUT_RING - 1)
+#error "SD_OUT_RING must be a power of 2"
+#endif
+
+// PIO clock cycles per PWM period, and high for a duty x
+#define SD_OUT_CYCLES (3 * (SD_OUT_PERIOD + 1) + 3)
+#define SD_OUT_HIGH(x) (3 * (x) + 2)
+
+typedef struct
+{
+    bool running;
+    uint sm;
+    uint data_chan;
+    // Three, so there is always one neither being read nor queued to be. The
+    // extra word keeps the address just past one ring distinct from the next
+    uint32_t rings[3][SD_OUT_RING + 1];
+    uint32_t *volatile ring_start; // Read by the restart channel
+} sd_channel_t;
+
+static PIO sd_pio = pio0;
+static int sd_offset = -1;
+static sd_channel_t sd_channels[SD_OUT_CHANNELS];
+
+bool sd_out_init(uint channel, uint pin)
+{
+    if (channel >= SD_OUT_CHANNELS || sd_channels[channel].running)
+        return false;
+    sd_channel_t *sd = &sd_channels[channel];
+
+    if (sd_offset < 0)
+    {
+        if (!pio_can_add_program(sd_pio, &sd_out_program))
+            return false;
+        sd_offset = pio_add_program(sd_pio, &sd_out_program);
+    }
+    int sm = pio_claim_unused_sm(sd_pio, false);
+    int data_chan = dma_claim_unused_channel(false);
+    int restart_chan = dma_claim_unused_channel(false);
+    if (sm < 0 || data_chan < 0 || restart_chan < 0)
+    {
+        if (sm >= 0)
+            pio_sm_unclaim(sd_pio, sm);
+        if (data_chan >= 0)
+            dma_channel_unclaim(data_chan);
+        if (restart_chan >= 0)
+            dma_channel_unclaim(restart_chan);
+        return false;
+    }
+    sd->sm = sm;
+    sd->data_chan = data_chan;
+    sd_out_program_init(sd_pio, sm, sd_offset, pin, SD_OUT_PERIOD);
+
+    // Off, every duty past the period
+    for (int i = 0; i < SD_OUT_RING; i++)
+    {
+        sd->rings[0][i] = UINT32_MAX;
+    }
+    sd->ring_start = sd->rings[0];
+
+    // One duty per PWM period, paced by the state machine pulling them
+    dma_channel_config data_cfg = dma_channel_get_default_config(data_chan);
+    channel_config_set_transfer_data_size(&data_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&data_cfg, true);
+    channel_config_set_write_increment(&data_cfg, false);
+    channel_config_set_dreq(&data_cfg, pio_get_dreq(sd_pio, sm, true));
+    channel_config_set_chain_to(&data_cfg, restart_chan);
+    dma_channel_configure(data_chan, &data_cfg, &sd_pio->txf[sm], sd->ring_start, SD_OUT_RING, false);
+
+    // Points the data channel at whichever ring ring_start says and triggers it
+    dma_channel_config restart_cfg = dma_channel_get_default_config(restart_chan);
+    channel_config_set_transfer_data_size(&restart_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&restart_cfg, false);
+    channel_config_set_write_increment(&restart_cfg, false);
+    dma_channel_configure(restart_chan, &restart_cfg, &dma_channel_hw_addr(data_chan)->al3_read_addr_trig,
+                          &sd->ring_start, 1, false);
+
+    dma_channel_start(data_chan);
+    pio_sm_set_enabled(sd_pio, sm, true);
+    sd->running = true;
+    return true;
+}
+
+void sd_out_set_volts(uint channel, float volts)
+{
+    if (channel >= SD_OUT_CHANNELS || !sd_channels[channel].running)
+        return;
+    sd_channel_t *sd = &sd_channels[channel];
+
+    if (volts < 0)
+        volts = 0;
+    if (volts > SD_OUT_FULL_SCALE_V)
+        volts = SD_OUT_FULL_SCALE_V;
+
+    // A ring the DMA is neither in, or just done with, nor restarting into next
+    uint32_t reading = dma_channel_hw_addr(sd->data_chan)->read_addr;
+    uint32_t *ring = NULL;
+    for (int i = 0; i < 3 && !ring; i++)
+    {
+        bool current = reading >= (uintptr_t)sd->rings[i] && reading <= (uintptr_t)&sd->rings[i][SD_OUT_RING];
+        if (!current && sd->rings[i] != sd->ring_start)
+            ring = sd->rings[i];
+    }
+
+    float high = volts / SD_OUT_FULL_SCALE_V * SD_OUT_CYCLES;
+    if (high < SD_OUT_HIGH(0) / 2.0f)
+    {
+        // Nearer 0V than the shortest pulse
+        for (int i = 0; i < SD_OUT_RING; i++)
+        {
+            ring[i] = UINT32_MAX;
+        }
+    }
+    else
+    {
+        // Duty as Q16, the fraction carried into whole counts by a first order
+        // sigma-delta so the ring averages to the exact level
+        float x = (high - SD_OUT_HIGH(0)) / 3;
+        uint32_t level = x > 0 ? (uint32_t)(x * 65536.0f) : 0;
+        uint32_t whole = level >> 16;
+        uint32_t frac = level & 0xFFFF;
+        uint32_t acc = 0x8000;
+        for (int i = 0; i < SD_OUT_RING; i++)
+        {
+            acc += frac;
+            uint32_t duty = whole + (acc >> 16);
+            acc &= 0xFFFF;
+            ring[i] = duty > SD_OUT_PERIOD ? SD_OUT_PERIOD : duty;
+        }
+    }
+    // The ring's words reach memory before the DMA can see its address
+    __dmb();
+    sd->ring_start = ring;
+}
+
+float sd_out_pwm_hz(void)
+{
+    return (float)clock_get_hz(clk_sys) / SD_OUT_CYCLES;
+}
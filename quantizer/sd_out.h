@@ -0,0 +1,44 @@
+#ifndef SD_OUT_H
+#define SD_OUT_H
+
+#include <stdint.h>
+#include "pico/stdlib.h"
+
+/*
+ CV out of a single GPIO, for builds or channels without an MCP4911. A PIO
+ state machine runs a PWM whose duty is fed every period by DMA from a ring of
+ SD_OUT_RING values, a second DMA channel restarts the ring when it is done,
+ so the output costs no CPU or SPI time once set. The ring holds a first order
+ sigma-delta sequence around the target level, which the output filter
+ averages to 1/SD_OUT_RING of a PWM step: 14 bits at the defaults below, with
+ the PWM at 162kHz (125MHz clk_sys) and the slowest ripple at 2.5kHz.
+
+ The output needs two RC sections, 3.3k and 100nF each for a 480Hz corner, and
+ a buffer with enough gain for SD_OUT_FULL_SCALE_V. That settles to 14 bits
+ within about 4ms of a new level, and takes the ripple below an LSB.
+
+ Each channel takes a state machine of pio0 and two DMA channels. A new level
+ is written into a ring the DMA isn't reading and is picked up at the end of
+ the current pass, 0.4ms at most, so the old and new patterns never mix.
+*/
+
+#define SD_OUT_PERIOD 255 // PWM counts per period, less one. 3 cycles a count
+#define SD_OUT_RING 64    // Duties per DMA pass, a power of 2
+#define SD_OUT_CHANNELS 4 // State machines in one PIO
+
+// Volts after the filter and gain stage at 100% duty, which the PWM itself
+// never quite reaches: it tops out at (3 * SD_OUT_PERIOD + 2) / (3 * SD_OUT_PERIOD + 6)
+// of this, 99.5%. So set the gain a little above the highest note needed
+#define SD_OUT_FULL_SCALE_V 5.1f
+
+// Starts channel (0 to SD_OUT_CHANNELS - 1) on pin at 0V. Returns false when
+// it can't get a state machine or the DMA channels
+bool sd_out_init(uint channel, uint pin);
+
+// Clamped to 0..SD_OUT_FULL_SCALE_V. Nothing happens on a channel not started
+void sd_out_set_volts(uint channel, float volts);
+
+// PWM carrier in Hz, the output filter needs to be well below SD_OUT_RING of it
+float sd_out_pwm_hz(void);
+
+#endif
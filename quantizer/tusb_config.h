@@ -0,0 +1,19 @@
+#ifndef TUSB_CONFIG_H
+#define TUSB_CONFIG_H
+
+// TinyUSB, for stdio over CDC (pico_stdio_usb) and the ADC stream. The
+// descriptors are in usb_descriptors.cpp
+
+#define CFG_TUSB_RHPORT0_MODE (OPT_MODE_DEVICE)
+#define CFG_TUD_ENDPOINT0_SIZE 64
+
+// As pico_stdio_usb has them
+#define CFG_TUD_CDC 1
+#define CFG_TUD_CDC_RX_BUFSIZE 256
+#define CFG_TUD_CDC_TX_BUFSIZE 256
+
+// The ADC stream is an application class driver (adc_stream.cpp), sending its
+// own buffers, rather than TinyUSB's vendor class, which copies into a FIFO
+#define CFG_TUD_VENDOR 0
+
+#endif
@@ -0,0 +1,127 @@
+#include "tusb.h"
+#include "pico/unique_id.h"
+
+/*
+ The USB device: pico_stdio_usb's CDC interface, as the SDK would describe it,
+ and the ADC stream's interface with one bulk IN endpoint. Building with our own
+ descriptors takes the SDK's reset interface away, picotool can't reboot the
+ board over USB, the 1200 baud reset still works.
+*/
+
+#define USBD_VID 0x2E8A // Raspberry Pi
+#define USBD_PID 0x000A // Raspberry Pi Pico SDK CDC, tools/adc_stream.py looks for it
+#define USBD_MAX_POWER_MA 250
+
+enum
+{
+    ITF_NUM_CDC,
+    ITF_NUM_CDC_DATA,
+    ITF_NUM_STREAM,
+    ITF_NUM_TOTAL
+};
+
+#define EPNUM_CDC_NOTIF 0x81
+#define EPNUM_CDC_OUT 0x02
+#define EPNUM_CDC_IN 0x82
+#define EPNUM_STREAM_IN 0x83
+
+#define USBD_CDC_CMD_MAX_SIZE 8
+#define USBD_CDC_IN_OUT_MAX_SIZE 64
+#define USBD_STREAM_IN_MAX_SIZE 64
+
+#define TUD_STREAM_DESC_LEN (9 + 7)
+#define USBD_DESC_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_STREAM_DESC_LEN)
+
+enum
+{
+    USBD_STR_0,
+    USBD_STR_MANUF,
+    USBD_STR_PRODUCT,
+    USBD_STR_SERIAL,
+    USBD_STR_CDC,
+    USBD_STR_STREAM,
+};
+
+static const tusb_desc_device_t usbd_desc_device = {
+    .bLength = sizeof(tusb_desc_device_t),
+    .bDescriptorType = TUSB_DESC_DEVICE,
+    .bcdUSB = 0x0200,
+    // The CDC functions are grouped by interface associations
+    .bDeviceClass = TUSB_CLASS_MISC,
+    .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol = MISC_PROTOCOL_IAD,
+    .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+    .idVendor = USBD_VID,
+    .idProduct = USBD_PID,
+    .bcdDevice = 0x0101, // Not the SDK's 0x0100, the interfaces differ
+    .iManufacturer = USBD_STR_MANUF,
+    .iProduct = USBD_STR_PRODUCT,
+    .iSerialNumber = USBD_STR_SERIAL,
+    .bNumConfigurations = 1,
+};
+
+static const uint8_t usbd_desc_cfg[USBD_DESC_LEN] = {
+    TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, USBD_STR_0, USBD_DESC_LEN, 0, USBD_MAX_POWER_MA),
+
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, USBD_STR_CDC, EPNUM_CDC_NOTIF, USBD_CDC_CMD_MAX_SIZE,
+                       EPNUM_CDC_OUT, EPNUM_CDC_IN, USBD_CDC_IN_OUT_MAX_SIZE),
+
+    // ADC stream: vendor specific interface, bulk IN only, controlled through EP0
+    9, TUSB_DESC_INTERFACE, ITF_NUM_STREAM, 0, 1, TUSB_CLASS_VENDOR_SPECIFIC, 0x00, 0x00, USBD_STR_STREAM,
+    7, TUSB_DESC_ENDPOINT, EPNUM_STREAM_IN, TUSB_XFER_BULK, U16_TO_U8S_LE(USBD_STREAM_IN_MAX_SIZE), 0,
+};
+
+static char usbd_serial_str[PICO_UNIQUE_BOARD_ID_SIZE_BYTES * 2 + 1];
+
+// In USBD_STR_ order
+static const char *const usbd_desc_str[] = {
+    "",
+    "Raspberry Pi",
+    "picoquantizer",
+    usbd_serial_str,
+    "picoquantizer stdio",
+    "picoquantizer ADC stream",
+};
+
+#define USBD_DESC_STR_MAX 32
+
+const uint8_t *tud_descriptor_device_cb(void)
+{
+    return (const uint8_t *)&usbd_desc_device;
+}
+
+const uint8_t *tud_descriptor_configuration_cb(uint8_t index)
+{
+    (void)index;
+    return usbd_desc_cfg;
+}
+
+const uint16_t *tud_descriptor_string_cb(uint8_t index, uint16_t langid)
+{
+    (void)langid;
+    static uint16_t desc_str[USBD_DESC_STR_MAX];
+
+    if (!usbd_serial_str[0])
+        pico_get_unique_board_id_string(usbd_serial_str, sizeof(usbd_serial_str));
+
+    uint8_t len;
+    if (index == 0)
+    {
+        desc_str[1] = 0x0409; // English
+        len = 1;
+    }
+    else
+    {
+        if (index >= sizeof(usbd_desc_str) / sizeof(usbd_desc_str[0]))
+            return NULL;
+        const char *str = usbd_desc_str[index];
+        for (len = 0; len < USBD_DESC_STR_MAX - 1 && str[len]; ++len)
+        {
+            desc_str[1 + len] = str[len];
+        }
+    }
+
+    // First byte is the length in bytes, second the descriptor type
+    desc_str[0] = (uint16_t)((TUSB_DESC_STRING << 8) | (2 * len + 2));
+    return desc_str;
+}
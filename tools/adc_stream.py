@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+"""Records the quantizer's CV inputs as the ADC sees them, at 500ksps over USB.
+
+    adc_stream.py scope.wav --channels ab --seconds 5
+    adc_stream.py scope.raw --channels a
+
+Starts the ADC stream (quantizer/adc_stream.h) with a vendor request, reads
+its bulk endpoint until --seconds have gone or Ctrl-C, then stops it. A .wav
+file gets 8 bit unsigned samples at 500kHz for one channel or 250kHz a
+channel for both, which any audio editor opens as a scope trace. Any other
+name gets the raw samples, interleaved A B when both. Buffers the host was
+too slow for are dropped on the module; their samples are written as 0 so
+the time axis holds, and counted at the end. The quantizer's outputs hold
+while it streams.
+
+Needs pyusb. The stream has an interface of its own, so the serial port
+stays usable meanwhile; on Linux the user needs access to the device, a udev
+rule for 2e8a:000a.
+"""
+
+import argparse
+import struct
+import sys
+import time
+import wave
+
+import usb.core
+import usb.util
+
+VID = 0x2E8A
+PID = 0x000A
+BUFFER_SIZE = 4096  # ADC_STREAM_BUFFER_SIZE
+HEADER = "<IIIBBH"
+MAGIC = 0x53415150
+REQUEST_START = 1
+REQUEST_STOP = 2
+CHANNELS = {"a": 0x01, "b": 0x02, "ab": 0x03}
+VENDOR_CLASS = 0xFF
+READ_TIMEOUT_MS = 1000
+DRAIN_SECONDS = 1.0
+
+# quantizer.cpp, for the summary in volts at the CV input
+INPUT_VOLTAGE_DIVISION = 0.333
+VOLTS_PER_COUNT = 3.3 / 256 / INPUT_VOLTAGE_DIVISION
+
+
+def open_stream(serial):
+    dev = usb.core.find(idVendor=VID, idProduct=PID,
+                        custom_match=lambda d: serial is None or d.serial_number == serial)
+    if dev is None:
+        raise SystemExit("no quantizer on USB")
+    cfg = dev.get_active_configuration()
+    intf = usb.util.find_descriptor(cfg, bInterfaceClass=VENDOR_CLASS)
+    if intf is None:
+        raise SystemExit("the quantizer has no ADC stream interface, older firmware?")
+    ep = usb.util.find_descriptor(
+        intf, custom_match=lambda e: usb.util.endpoint_direction(e.bEndpointAddress) == usb.util.ENDPOINT_IN)
+    usb.util.claim_interface(dev, intf)
+    return dev, intf.bInterfaceNumber, ep
+
+
+def request(dev, itf, req, value=0):
+    dev.ctrl_transfer(usb.util.CTRL_OUT | usb.util.CTRL_TYPE_VENDOR | usb.util.CTRL_RECIPIENT_INTERFACE,
+                      req, value, itf)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("out", help=".wav, or anything else for raw samples")
+    parser.add_argument("--channels", choices=CHANNELS, default="a", help="inputs to stream")
+    parser.add_argument("--seconds", type=float, help="stop after this long, else at Ctrl-C")
+    parser.add_argument("--serial", help="USB serial number, when there are several Picos")
+    args = parser.parse_args()
+
+    dev, itf, ep = open_stream(args.serial)
+    mask = CHANNELS[args.channels]
+    nchannels = bin(mask).count("1")
+    header_size = struct.calcsize(HEADER)
+
+    if args.out.endswith(".wav"):
+        out = wave.open(args.out, "wb")
+        out.setnchannels(nchannels)
+        out.setsampwidth(1)
+        out.setframerate(500000 // nchannels)
+        write = out.writeframesraw
+    else:
+        out = open(args.out, "wb")
+        write = out.write
+
+    # Whatever a stream before left on the endpoint. A run that was killed never
+    # sent its stop, so stop first, and give up draining after a while anyway
+    request(dev, itf, REQUEST_STOP)
+    deadline = time.monotonic() + DRAIN_SECONDS
+    try:
+        while time.monotonic() < deadline:
+            ep.read(BUFFER_SIZE, timeout=50)
+    except usb.core.USBTimeoutError:
+        pass
+
+    request(dev, itf, REQUEST_START, mask)
+    start = time.monotonic()
+    expected = 0
+    buffers = dropped = 0
+    # Per channel, of what came through
+    low = [255] * nchannels
+    high = [0] * nchannels
+    total = [0] * nchannels
+    try:
+        while args.seconds is None or time.monotonic() - start < args.seconds:
+            block = bytes(ep.read(BUFFER_SIZE, timeout=READ_TIMEOUT_MS))
+            if len(block) != BUFFER_SIZE:
+                raise SystemExit(f"short buffer, {len(block)} bytes")
+            magic, seq, _, _, _, lost = struct.unpack_from(HEADER, block)
+            if magic != MAGIC:
+                raise SystemExit("bad buffer magic")
+            if seq != expected + lost:
+                # The module counts what it dropped, anything else went missing on the way
+                print(f"buffer {seq}, expected {expected + lost}", file=sys.stderr)
+            payload = block[header_size:]
+            missing = seq - expected
+            if missing > 0:
+                write(bytes(len(payload) * missing))
+                dropped += missing
+            write(payload)
+            expected = seq + 1
+            buffers += 1
+            for i in range(nchannels):
+                samples = payload[i::nchannels]
+                low[i] = min(low[i], min(samples))
+                high[i] = max(high[i], max(samples))
+                total[i] += sum(samples)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        request(dev, itf, REQUEST_STOP)
+        usb.util.release_interface(dev, itf)
+        out.close()
+
+    seconds = time.monotonic() - start
+    rate = buffers * (BUFFER_SIZE - header_size) / seconds / 1000
+    print(f"{buffers} buffers in {seconds:.1f}s, {rate:.0f}KB/s, {dropped} dropped")
+    per_channel = buffers * (BUFFER_SIZE - header_size) // nchannels
+    for i, name in enumerate(args.channels.upper()):
+        if per_channel:
+            print(f"{name}: min {low[i] * VOLTS_PER_COUNT:.3f}V max {high[i] * VOLTS_PER_COUNT:.3f}V "
+                  f"mean {total[i] / per_channel * VOLTS_PER_COUNT:.3f}V")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""Puts quantizer profiler dumps side by side, in microseconds.
+
+Capture a dump ('p' over USB) from each build after the same gates, for
+instance the same firmware source on a pico (RP2040) and a pico2 (RP2350):
+
+    compare_profiles.py rp2040.log rp2350.log
+
+Each file may hold other output around the dump, the last dump in it is
+used. The cycle counts of each stage are converted with the clk_sys the dump
+reports, so boards at different clocks compare in time.
+"""
+
+import argparse
+import re
+import sys
+
+STAGE = re.compile(r"(\w+)\s+(\d+)\s+(\d+)\s+(\d+)\s+(\d+)\s+\(")
+LATENCY = re.compile(r"((?:cold|warm) (?:edge|queued|path))\s+(\d+)\s+([\d.]+)\s+([\d.]+)\s+([\d.]+)\s+([\d.]+)")
+# Edge to DAC is the queue wait plus the handler's path, only the path is down to
+# where the code runs and clk_sys
+LATENCY_ROWS = ("cold path", "warm path", "cold queued", "warm queued", "cold edge", "warm edge")
+
+
+def parse(path):
+    with open(path, errors="replace") as f:
+        text = f.read()
+    start = text.rfind("--- profile")
+    end = text.find("--- end profile ---", start)
+    if start < 0 or end < 0:
+        raise SystemExit(f"{path}: no profiler dump")
+    lines = text[start:end].splitlines()
+
+    header = re.search(r"clk_sys ([\d.]+)MHz, code in (\w+)", lines[0])
+    if not header:
+        raise SystemExit(f"{path}: unreadable dump header")
+    mhz = float(header.group(1))
+    chip = re.search(r"chip (\w+), float (\w+), burst sum (\w+)", "\n".join(lines))
+    label = f"{chip.group(1) if chip else '?'} {mhz:g}MHz {header.group(2)}"
+
+    stages = {}
+    latency = {}
+    for line in lines[1:]:
+        if line.startswith("histogram"):
+            break
+        m = LATENCY.match(line)
+        if m:
+            # Already in us
+            latency[m.group(1)] = (int(m.group(2)), float(m.group(4)), float(m.group(5)), float(m.group(6)))
+            continue
+        m = STAGE.match(line)
+        if m:
+            count, _, avg, peak = (int(g) for g in m.groups()[1:])
+            stages[m.group(1)] = (count, avg / mhz, peak / mhz)
+    kernels = f"float {chip.group(2)}, burst sum {chip.group(3)}" if chip else ""
+    return {"label": label, "kernels": kernels, "stages": stages, "latency": latency}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("dumps", nargs="+", help="files holding a profiler dump each")
+    args = parser.parse_args()
+
+    profiles = [parse(path) for path in args.dumps]
+    width = max(22, *(len(p["label"]) + 2 for p in profiles))
+    print(" " * 10 + "".join(f"{p['label']:>{width}}" for p in profiles))
+    for p in profiles:
+        if p["kernels"]:
+            print(f"  {p['label']}: {p['kernels']}")
+
+    print("stage avg / max (us)")
+    names = []
+    for p in profiles:
+        names += [name for name in p["stages"] if name not in names]
+    for name in names:
+        cells = []
+        for p in profiles:
+            stage = p["stages"].get(name)
+            cells.append(f"{stage[1]:.1f} / {stage[2]:.1f}" if stage else "-")
+        print(f"{name:<10}" + "".join(f"{cell:>{width}}" for cell in cells))
+
+    print("gate latency less settle and capture, avg / max / jitter (us)")
+    for kind in LATENCY_ROWS:
+        cells = []
+        for p in profiles:
+            latency = p["latency"].get(kind)
+            cells.append(f"{latency[1]:.1f} / {latency[2]:.1f} / {latency[3]:.1f}" if latency else "-")
+        print(f"{kind:<12}" + "".join(f"{cell:>{width}}" for cell in cells))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""Generates a kiss_fftr plan for a fixed nfft as const C data.
+
+The plan kiss_fftr_alloc() would build at startup, with the factors and the
+twiddles computed here instead, so they can live in flash and nothing is
+malloc'd. The only RAM left is the nfft/2 point scratch buffer, which is a
+static array and shows up in the link map.
+
+    gen_fft_plan.py --nfft 512 --name fft_plan --out-dir build/
+
+writes fft_plan.c and fft_plan.h. Only forward float transforms are made.
+
+With --window hann the window table goes in as well, with its DFT at bins 0
+and 1, which is what a constant offset under the window leaks into. The mean
+can then come off after the transform instead of in a pass before it.
+"""
+
+import argparse
+import math
+import os
+import struct
+
+MAXFACTORS = 32  # _kiss_fft_guts.h
+
+
+def factor(n):
+    """Same factorisation as kf_factor() in kiss_fft.c: p1, m1, p2, m2, ..."""
+    factors = []
+    p = 4
+    floor_sqrt = math.floor(math.sqrt(n))
+    while True:
+        while n % p:
+            p = {4: 2, 2: 3}.get(p, p + 2)
+            if p > floor_sqrt:
+                p = n
+        n //= p
+        factors += [p, n]
+        if n <= 1:
+            return factors
+
+
+def f32(x):
+    """Literal that rounds to the same float as the (float) cast in kf_cexp()"""
+    text = "%.9g" % struct.unpack("f", struct.pack("f", x))[0]
+    if not any(c in text for c in ".en"):
+        text += ".0"
+    return text + "f"
+
+
+def cpx_rows(values, indent="        "):
+    return ",\n".join("%s{%s, %s}" % (indent, f32(math.cos(phase)), f32(math.sin(phase))) for phase in values)
+
+
+def window_values(window, nfft):
+    if window == "hann":
+        # Periodic, so its DFT is exactly zero past bin 1
+        return [0.5 - 0.5 * math.cos(2 * math.pi * i / nfft) for i in range(nfft)]
+    raise SystemExit("unknown window " + window)
+
+
+def generate(nfft, name, window=None):
+    if nfft % 2 or nfft < 4:
+        raise SystemExit("nfft must be even and at least 4")
+    ncfft = nfft // 2
+    factors = factor(ncfft)
+    if len(factors) > 2 * MAXFACTORS:
+        raise SystemExit("too many factors for MAXFACTORS")
+
+    # kiss_fft_alloc() and kiss_fftr_alloc(), forward transform
+    twiddles = [-2 * math.pi * i / ncfft for i in range(ncfft)]
+    super_twiddles = [-math.pi * ((i + 1) / ncfft + 0.5) for i in range(ncfft // 2)]
+
+    args = f"--nfft {nfft} --name {name}" + (f" --window {window}" if window else "")
+    window_decl = ""
+    window_data = ""
+    if window:
+        w = window_values(window, nfft)
+        bins = [(sum(w), 0.0), (sum(x * math.cos(2 * math.pi * i / nfft) for i, x in enumerate(w)),
+                                -sum(x * math.sin(2 * math.pi * i / nfft) for i, x in enumerate(w)))]
+        window_decl = f"""
+// {window} window and its DFT at bins 0 and 1
+extern const float {name}_window[{nfft}];
+extern const kiss_fft_cpx {name}_window_bins[2];
+"""
+        rows = ",\n".join("    " + ", ".join(f32(x) for x in w[i:i + 8]) for i in range(0, nfft, 8))
+        window_data = f"""
+const float {name}_window[{nfft}] = {{
+{rows}
+}};
+
+const kiss_fft_cpx {name}_window_bins[2] = {{{{{f32(bins[0][0])}, {f32(bins[0][1])}}}, {{{f32(bins[1][0])}, {f32(bins[1][1])}}}}};
+"""
+
+    header = f"""/* Generated by tools/gen_fft_plan.py {args}, do not edit */
+#ifndef {name.upper()}_H
+#define {name.upper()}_H
+
+#include "kiss_fftr.h"
+
+#define {name.upper()}_NFFT {nfft}
+#define {name.upper()}_WINDOWED {1 if window else 0}
+
+// Forward real FFT plan for {nfft} points, const apart from its scratch buffer
+extern const kiss_fftr_cfg {name};
+{window_decl}
+#endif
+"""
+
+    source = f"""/* Generated by tools/gen_fft_plan.py {args}, do not edit */
+#include "{name}.h"
+#include "_kiss_fft_guts.h"
+
+static kiss_fft_cpx {name}_tmpbuf[{ncfft}];
+
+// Same layout as kiss_fftr_alloc() builds: the real state followed by the
+// complex substate with its twiddles inline, then the super twiddles
+static const struct
+{{
+    struct kiss_fftr_state fftr;
+    struct
+    {{
+        int nfft;
+        int inverse;
+        int factors[2 * MAXFACTORS];
+        kiss_fft_cpx twiddles[{ncfft}];
+    }} fft;
+    kiss_fft_cpx super_twiddles[{ncfft // 2}];
+}} {name}_data = {{
+    {{(kiss_fft_cfg)&{name}_data.fft, {name}_tmpbuf, (kiss_fft_cpx *){name}_data.super_twiddles}},
+    {{
+        {ncfft},
+        0,
+        {{{", ".join(str(f) for f in factors)}}},
+        {{
+{cpx_rows(twiddles, "            ")}
+        }},
+    }},
+    {{
+{cpx_rows(super_twiddles)}
+    }},
+}};
+
+const kiss_fftr_cfg {name} = (kiss_fftr_cfg)&{name}_data.fftr;
+{window_data}"""
+    return header, source
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--nfft", type=int, required=True, help="real transform length")
+    parser.add_argument("--name", default="fft_plan", help="symbol and file name")
+    parser.add_argument("--out-dir", default=".", help="where to write NAME.c and NAME.h")
+    parser.add_argument("--window", choices=["hann"], help="also emit this window as NAME_window")
+    args = parser.parse_args()
+
+    header, source = generate(args.nfft, args.name, args.window)
+    os.makedirs(args.out_dir, exist_ok=True)
+    for ext, text in (("h", header), ("c", source)):
+        with open(os.path.join(args.out_dir, f"{args.name}.{ext}"), "w") as f:
+            f.write(text)
+
+
+if __name__ == "__main__":
+    main()
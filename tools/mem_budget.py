@@ -0,0 +1,201 @@
+#!/usr/bin/env python3
+"""Checks a Pico link map against RAM budgets and reports the headroom.
+
+Run after the link, on the map pico_add_extra_outputs() writes:
+
+    mem_budget.py build/blink.elf.map --static-max 128K --heap-min 16K \\
+        --stack-min 2K --nsamp 512 --nsamp-symbols capture_bufs,history,fft_in
+
+It prints what each memory region holds and exits 1 when
+- a region is over its length,
+- .data + .bss in main RAM is over --static-max,
+- less than --heap-min is left between the end of .bss and the top of RAM,
+  which is all malloc() gets on the Pico,
+- the core 0 stack (.stack_dummy, PICO_STACK_SIZE) is under --stack-min.
+
+With --nsamp, the buffers in --nsamp-symbols are taken to grow linearly with
+NSAMP, and the largest NSAMP that still meets the budgets is reported.
+Only named sections are seen per symbol, which the SDK's -fdata-sections and
+the __scratch_x()/__scratch_y() macros give.
+"""
+
+import argparse
+import re
+import sys
+
+# Output sections that hold static data in main RAM, the rest of RAM is heap
+STATIC_SECTIONS = (".ram_vector_table", ".uninitialized_data", ".data", ".tdata", ".tbss", ".bss")
+HEAP_END_SYMBOLS = ("__end__", "end")
+CORE0_STACK = ".stack_dummy"
+
+HEX = r"0x([0-9a-fA-F]+)"
+
+
+def size_arg(text):
+    """Bytes, with an optional K suffix"""
+    text = text.strip().upper()
+    if text.endswith("K"):
+        return int(text[:-1]) * 1024
+    return int(text, 0)
+
+
+class LinkMap:
+    def __init__(self, path):
+        self.regions = {}  # name: (origin, length)
+        self.sections = []  # (name, address, size) of the output sections
+        self.inputs = []  # (output section, input section, address, size)
+        self.symbols = {}
+        self._parse(path)
+
+    def _parse(self, path):
+        with open(path) as f:
+            lines = f.read().splitlines()
+
+        i = 0
+        while i < len(lines) and not lines[i].startswith("Memory Configuration"):
+            i += 1
+        for line in lines[i + 1:]:
+            if line.startswith("Linker script and memory map"):
+                break
+            m = re.match(r"(\S+)\s+" + HEX + r"\s+" + HEX, line)
+            if m and m.group(1) != "*default*":
+                self.regions[m.group(1)] = (int(m.group(2), 16), int(m.group(3), 16))
+            i += 1
+
+        output = None
+        pending = None  # Name on a line of its own, the address and size follow
+        for line in lines[i:]:
+            if pending:
+                m = re.match(r"\s+" + HEX + r"\s+" + HEX, line)
+                if m:
+                    self._add(pending, output, int(m.group(1), 16), int(m.group(2), 16))
+                    if not pending[1]:
+                        output = pending[0]
+                pending = None
+                continue
+
+            m = re.match(r"(\.\S+)(?:\s+" + HEX + r"\s+" + HEX + r")?", line)
+            if m:
+                output = m.group(1)
+                if m.group(2):
+                    self._add((output, False), output, int(m.group(2), 16), int(m.group(3), 16))
+                else:
+                    pending = (output, False)
+                continue
+
+            m = re.match(r" (\.\S+|COMMON)(?:\s+" + HEX + r"\s+" + HEX + r")?", line)
+            if m and output:
+                if m.group(2):
+                    self._add((m.group(1), True), output, int(m.group(2), 16), int(m.group(3), 16))
+                else:
+                    pending = (m.group(1), True)
+                continue
+
+            # Assignments and the globals listed under an input section
+            m = re.match(r"\s+" + HEX + r"\s+(?:PROVIDE \()?([A-Za-z_][\w.]*)", line)
+            if m:
+                self.symbols.setdefault(m.group(2), int(m.group(1), 16))
+
+    def _add(self, name, output, address, size):
+        section, is_input = name
+        if is_input:
+            self.inputs.append((output, section, address, size))
+        else:
+            self.sections.append((section, address, size))
+
+    def region_of(self, address):
+        for name, (origin, length) in self.regions.items():
+            if origin <= address < origin + length:
+                return name
+        return None
+
+    def section_size(self, name):
+        return sum(size for section, _, size in self.sections if section == name)
+
+    def symbol_size(self, symbol):
+        """Size and region of the input section named after a symbol"""
+        for _, section, address, size in self.inputs:
+            if section.rsplit(".", 1)[-1] == symbol and size:
+                return size, self.region_of(address)
+        return None, None
+
+
+def kib(n):
+    return "%.1fK" % (n / 1024)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("map", help="linker map file")
+    parser.add_argument("--static-max", type=size_arg, help="most .data + .bss allowed in main RAM")
+    parser.add_argument("--heap-min", type=size_arg, default=0, help="least RAM to leave for the heap")
+    parser.add_argument("--stack-min", type=size_arg, default=0, help="least core 0 stack")
+    parser.add_argument("--nsamp", type=int, help="NSAMP the program was built with")
+    parser.add_argument("--nsamp-symbols", default="", help="comma separated buffers sized by NSAMP")
+    args = parser.parse_args()
+
+    link = LinkMap(args.map)
+    if "RAM" not in link.regions:
+        sys.exit(f"{args.map}: no RAM region in the memory configuration")
+    errors = []
+
+    # Everything placed in each region, stacks included
+    used = {name: 0 for name in link.regions}
+    for name, address, size in link.sections:
+        region = link.region_of(address)
+        if region and size and name != ".heap":
+            used[region] += size
+    # Initialised data sits in RAM and has its load copy in flash
+    for name in used:
+        if name.startswith("FLASH"):
+            used[name] += link.section_size(".data")
+    print("region        used      size      free")
+    for name, (origin, length) in link.regions.items():
+        free = length - used[name]
+        print(f"{name:<12}{kib(used[name]):>6}  {kib(length):>8}  {kib(free):>8}")
+        if free < 0:
+            errors.append(f"{name} is {-free} bytes over")
+
+    static = sum(link.section_size(name) for name in STATIC_SECTIONS)
+    ram_origin, ram_length = link.regions["RAM"]
+    heap_start = next((link.symbols[s] for s in HEAP_END_SYMBOLS if s in link.symbols), ram_origin + static)
+    heap = ram_origin + ram_length - heap_start
+    stack = link.section_size(CORE0_STACK)
+
+    print(f"static {kib(static)}, heap {kib(heap)}, core 0 stack {kib(stack)}")
+    if args.static_max is not None and static > args.static_max:
+        errors.append(f"static data {static} bytes, budget {args.static_max}")
+    if heap < args.heap_min:
+        errors.append(f"heap {heap} bytes, needs {args.heap_min}")
+    if stack < args.stack_min:
+        errors.append(f"core 0 stack {stack} bytes, needs {args.stack_min}")
+
+    if args.nsamp:
+        # Bytes per sample in each region, and what the budgets leave there
+        per_sample = {}
+        for symbol in filter(None, args.nsamp_symbols.split(",")):
+            size, region = link.symbol_size(symbol)
+            if size is None:
+                print(f"warning: {symbol} not found in the map", file=sys.stderr)
+                continue
+            per_sample[region] = per_sample.get(region, 0) + size / args.nsamp
+
+        spare = {name: length - used[name] for name, (_, length) in link.regions.items()}
+        spare["RAM"] = heap - args.heap_min
+        if args.static_max is not None:
+            spare["RAM"] = min(spare["RAM"], args.static_max - static)
+        limits = []
+        for region, rate in per_sample.items():
+            limits.append((args.nsamp + max(0, spare[region]) / rate, region))
+            print(f"{region}: {rate:.1f} bytes per sample, {kib(spare[region])} spare")
+        if limits:
+            nsamp, region = min(limits)
+            print(f"NSAMP {args.nsamp}, budgets allow up to {int(nsamp)} (limited by {region})")
+
+    for error in errors:
+        print("error: " + error, file=sys.stderr)
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,229 @@
+#!/usr/bin/env python3
+"""Compiles a Scala tuning (.scl, optionally with a .kbm mapping) into the
+quantizer's tuning table.
+
+The table lists every note of the tuning that fits the DAC range, each with
+the lowest input voltage that quantizes to it, its DAC code and its scale
+degree. The firmware expands it into a lookup indexed by ADC step, so a gate
+costs one table read whatever the tuning.
+
+    scala_table.py 19edo.scl --out 19edo.bin
+    scala_table.py pyth.scl --kbm pyth.kbm --header tuning_default.h
+
+--out writes the binary the firmware takes over USB (see upload_tuning.py),
+--header writes it as a C array for a build time default (QUANTIZER_SCALA in
+quantizer/CMakeLists.txt).
+
+Without a .kbm degree 0 sits at 0V (FREQ_0V in quantize.h) and the scale
+repeats every period, 1V per octave. With one, its reference note and
+frequency place the keys, and unmapped keys ("x") are left out.
+
+Table layout, little endian, see tuning_load() in quantize.cpp:
+    0   "PQTT"
+    4   u8  version
+    5   u8  degrees per period
+    6   u16 number of notes
+    8   u16 full scale output in mV
+    10  u16 DAC code at full scale
+    12  u16 sum of the note bytes, mod 65536
+    14  u16 reserved, 0
+    16  notes, 6 bytes each: u16 input mV, u16 DAC code, u8 degree, u8 0
+"""
+
+import argparse
+import math
+import os
+import struct
+import sys
+
+MAGIC = b"PQTT"
+VERSION = 1
+HEADER = "<4sBBHHHHH"
+NOTE = "<HHBB"
+MAX_NOTES = 256  # TUNING_MAX_NOTES in quantize.h
+FREQ_0V = 16.35  # quantize.h
+
+
+def scala_lines(path):
+    """Lines of a Scala file without the ! comments"""
+    with open(path, encoding="latin-1") as f:
+        for line in f:
+            line = line.rstrip("\r\n")
+            if not line.startswith("!"):
+                yield line
+
+
+def parse_pitch(text, path):
+    """Cents from a .scl pitch line: cents if it has a '.', else a ratio"""
+    token = text.split()[0] if text.split() else ""
+    try:
+        if "." in token:
+            return float(token)
+        num, _, den = token.partition("/")
+        ratio = int(num) / int(den or 1)
+    except (ValueError, ZeroDivisionError):
+        raise SystemExit(f"{path}: bad pitch '{text.strip()}'")
+    if ratio <= 0:
+        raise SystemExit(f"{path}: bad pitch '{text.strip()}'")
+    return 1200 * math.log2(ratio)
+
+
+def read_scl(path):
+    """Cents of degrees 1..n, the last one being the period"""
+    lines = scala_lines(path)
+    next(lines, None)  # description
+    try:
+        count = int(next(lines).split()[0])
+    except (StopIteration, ValueError, IndexError):
+        raise SystemExit(f"{path}: missing note count")
+    cents = [parse_pitch(line, path) for line in lines if line.strip()][:count]
+    if count < 1 or len(cents) != count:
+        raise SystemExit(f"{path}: expected {count} pitches, found {len(cents)}")
+    if cents[-1] <= 0:
+        raise SystemExit(f"{path}: the period must be above the unison")
+    return cents
+
+
+def read_kbm(path):
+    values = [line.split()[0] for line in scala_lines(path) if line.split()]
+    if len(values) < 7:
+        raise SystemExit(f"{path}: too short for a keyboard mapping")
+    try:
+        size, first, last, middle, reference = (int(v) for v in values[:5])
+        frequency = float(values[5])
+        octave_degree = int(values[6])
+    except ValueError:
+        raise SystemExit(f"{path}: bad header")
+    mapping = [None if v.lower() == "x" else int(v) for v in values[7:7 + size]]
+    # Missing entries are unmapped
+    mapping += [None] * (size - len(mapping))
+    return {
+        "size": size, "first": first, "last": last, "middle": middle,
+        "reference": reference, "frequency": frequency,
+        "octave_degree": octave_degree, "mapping": mapping,
+    }
+
+
+def degree_cents(scale, degree):
+    """Cents of any scale degree, wrapping through the period"""
+    count = len(scale)
+    period, step = divmod(degree, count)
+    return period * scale[-1] + (scale[step - 1] if step else 0.0)
+
+
+def key_degree(kbm, key):
+    """Scale degree of a key under the mapping, None when unmapped"""
+    offset = key - kbm["middle"]
+    if kbm["size"] == 0:
+        return offset
+    period, index = divmod(offset, kbm["size"])
+    degree = kbm["mapping"][index]
+    if degree is None:
+        return None
+    octave_degree = kbm["octave_degree"] or kbm["size"]
+    return period * octave_degree + degree
+
+
+def note_volts(scale, kbm, vmax):
+    """(volts, degree) of every note in [0, vmax], ascending"""
+    count = len(scale)
+    notes = []
+    if kbm is None:
+        degree = 0
+        while True:
+            volts = degree_cents(scale, degree) / 1200
+            if volts > vmax:
+                break
+            notes.append((volts, degree % count))
+            degree += 1
+        return notes
+
+    reference_degree = key_degree(kbm, kbm["reference"])
+    if reference_degree is None:
+        raise SystemExit("the .kbm reference note is unmapped")
+    reference_cents = degree_cents(scale, reference_degree)
+    for key in range(kbm["first"], kbm["last"] + 1):
+        degree = key_degree(kbm, key)
+        if degree is None:
+            continue
+        cents = degree_cents(scale, degree) - reference_cents
+        volts = math.log2(kbm["frequency"] / FREQ_0V) + cents / 1200
+        if 0 <= volts <= vmax:
+            notes.append((volts, degree % count))
+    notes.sort()
+    return notes
+
+
+def build_table(notes, degrees, vmax, dac_max, snap):
+    if not notes:
+        raise SystemExit("no notes of the tuning fall inside the output range")
+    if len(notes) > MAX_NOTES:
+        raise SystemExit(f"{len(notes)} notes in range, the firmware takes {MAX_NOTES}")
+    if degrees > 255:
+        raise SystemExit("at most 255 degrees per period")
+
+    body = b""
+    previous = None
+    for volts, degree in notes:
+        # Inputs from this note up quantize to it, or from halfway to the one below
+        start = volts if snap == "down" or previous is None else (previous + volts) / 2
+        code = min(dac_max, round(volts / vmax * dac_max))
+        body += struct.pack(NOTE, round(start * 1000), code, degree, 0)
+        previous = volts
+
+    header = struct.pack(HEADER, MAGIC, VERSION, degrees, len(notes),
+                         round(vmax * 1000), dac_max, sum(body) & 0xFFFF, 0)
+    return header + body
+
+
+def c_header(table, name, source):
+    rows = []
+    for i in range(0, len(table), 12):
+        rows.append("    " + ", ".join("0x%02x" % b for b in table[i:i + 12]) + ",")
+    guard = name.upper() + "_H"
+    return f"""/* Generated by tools/scala_table.py from {source}, do not edit */
+#ifndef {guard}
+#define {guard}
+
+#include <stdint.h>
+
+static const uint8_t {name}[{len(table)}] = {{
+{chr(10).join(rows)}
+}};
+
+#endif
+"""
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("scl", help="Scala scale file")
+    parser.add_argument("--kbm", help="Scala keyboard mapping")
+    parser.add_argument("--vmax", type=float, default=5.0, help="DAC full scale in volts (SPI_VMAX)")
+    parser.add_argument("--dac-max", type=int, default=1023, help="DAC code at full scale")
+    parser.add_argument("--snap", choices=["down", "nearest"], default="down",
+                        help="inputs go to the note at or below them, or to the closest one")
+    parser.add_argument("--out", help="binary table to write")
+    parser.add_argument("--header", help="C header to write the table into")
+    parser.add_argument("--name", default="tuning_default", help="array name in the header")
+    args = parser.parse_args()
+
+    scale = read_scl(args.scl)
+    kbm = read_kbm(args.kbm) if args.kbm else None
+    notes = note_volts(scale, kbm, args.vmax)
+    table = build_table(notes, len(scale), args.vmax, args.dac_max, args.snap)
+
+    if args.out:
+        with open(args.out, "wb") as f:
+            f.write(table)
+    if args.header:
+        os.makedirs(os.path.dirname(os.path.abspath(args.header)), exist_ok=True)
+        sources = os.path.basename(args.scl) + (" " + os.path.basename(args.kbm) if args.kbm else "")
+        with open(args.header, "w") as f:
+            f.write(c_header(table, args.name, sources))
+    print(f"{len(notes)} notes, {len(scale)} per period, {notes[0][0]:.3f}V to {notes[-1][0]:.3f}V, "
+          f"{len(table)} bytes", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+"""Sends a tuning table from scala_table.py to the quantizer over USB serial.
+
+    upload_tuning.py /dev/ttyACM0 19edo.bin
+    upload_tuning.py /dev/ttyACM0 --reset
+
+The firmware takes a 't' followed by the table and answers with a "tuning:"
+line; --reset sends 'e' to go back to 12-TET. The quantizer keeps printing
+while it runs, so lines up to the answer are skipped.
+"""
+
+import argparse
+import os
+import select
+import sys
+import termios
+import time
+import tty
+
+UPLOAD = b"t"
+RESET = b"e"
+TIMEOUT_S = 3
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port", help="USB serial device of the quantizer")
+    parser.add_argument("table", nargs="?", help="table written by scala_table.py --out")
+    parser.add_argument("--reset", action="store_true", help="go back to 12-TET")
+    args = parser.parse_args()
+    if not args.reset and not args.table:
+        parser.error("a table or --reset is needed")
+
+    message = RESET
+    if not args.reset:
+        with open(args.table, "rb") as f:
+            message = UPLOAD + f.read()
+
+    fd = os.open(args.port, os.O_RDWR | os.O_NOCTTY)
+    try:
+        # Raw, so no byte of the table is taken as a control character
+        tty.setraw(fd)
+        termios.tcflush(fd, termios.TCIFLUSH)
+        os.write(fd, message)
+
+        line = b""
+        deadline = time.monotonic() + TIMEOUT_S
+        while time.monotonic() < deadline:
+            if not select.select([fd], [], [], 0.1)[0]:
+                continue
+            line += os.read(fd, 256)
+            while b"\n" in line:
+                answer, line = line.split(b"\n", 1)
+                answer = answer.decode("ascii", "replace").strip()
+                if answer.startswith("tuning:"):
+                    print(answer)
+                    return 1 if any(word in answer for word in ("malformed", "wrong", "timed out")) else 0
+        print("no answer from the quantizer", file=sys.stderr)
+        return 1
+    finally:
+        os.close(fd)
+
+
+if __name__ == "__main__":
+    sys.exit(main())